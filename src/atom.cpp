@@ -229,7 +229,7 @@ bool atom::has_covalent_bond(const atom& a) const
 	return distance_sqr(coord, a.coord) < s * s;
 }
 
-void atom::output(boost::filesystem::ofstream& ofs, const array<float, 3>& coord) const
+void atom::output(ostream& os, const array<float, 3>& coord) const
 {
-	ofs << "ATOM  " << setw(5) << serial << ' ' << name << setw(14) << "" << setw(8) << coord[0] << setw(8) << coord[1] << setw(8) << coord[2] << setw(23) << "" << ad_strings[ad] << (ad_strings[ad].size() == 1 ? " " : "") << '\n';
+	os << "ATOM  " << setw(5) << serial << ' ' << name << setw(14) << "" << setw(8) << coord[0] << setw(8) << coord[1] << setw(8) << coord[2] << setw(23) << "" << ad_strings[ad] << (ad_strings[ad].size() == 1 ? " " : "") << '\n';
 }
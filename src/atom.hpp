@@ -61,7 +61,7 @@ public:
 	bool has_covalent_bond(const atom& a) const;
 
 	//! Outputs an ATOM line in PDBQT format.
-	void output(boost::filesystem::ofstream& ofs, const array<float, 3>& coord) const;
+	void output(ostream& os, const array<float, 3>& coord) const;
 };
 
 #endif
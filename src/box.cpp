@@ -0,0 +1,60 @@
+#include <limits>
+#include <algorithm>
+#include "box.hpp"
+
+box::box(istream& is, const vector<string>& residues, const float margin) : center{}, size{}, num_atoms(0)
+{
+	array<float, 3> mn, mx;
+	mn.fill(numeric_limits<float>::max());
+	mx.fill(numeric_limits<float>::lowest());
+	for (string line; getline(is, line);)
+	{
+		const string record = line.substr(0, 6);
+		if (record != "ATOM  " && record != "HETATM") continue;
+
+		// Skip hydrogens, whose AutoDock4 atom types are H and HD.
+		if (line.size() < 54) continue;
+		const string ad = line.size() > 78 ? line.substr(77, isspace(line[78]) ? 1 : 2) : line.size() > 77 ? line.substr(77, 1) : string();
+		if (ad == "H" || ad == "HD") continue;
+
+		// Filter atoms by residue, e.g. A:123 matches chain A and residue sequence 123.
+		if (!residues.empty())
+		{
+			const char chain = line[21];
+			const string seq = line.substr(22, 4);
+			const size_t s = seq.find_first_not_of(' ');
+			const string trimmed = s == string::npos ? string() : seq.substr(s);
+			if (find_if(residues.cbegin(), residues.cend(), [&](const string& r)
+			{
+				const size_t colon = r.find(':');
+				return colon == string::npos ? r == trimmed : r.substr(colon + 1) == trimmed && (colon == 0 || r[0] == chain);
+			}) == residues.cend()) continue;
+		}
+
+		const array<float, 3> c = {{ stof(line.substr(30, 8)), stof(line.substr(38, 8)), stof(line.substr(46, 8)) }};
+		for (size_t i = 0; i < 3; ++i)
+		{
+			mn[i] = min(mn[i], c[i]);
+			mx[i] = max(mx[i], c[i]);
+		}
+		++num_atoms;
+	}
+	if (!num_atoms) return;
+	for (size_t i = 0; i < 3; ++i)
+	{
+		center[i] = 0.5f * (mn[i] + mx[i]);
+		size[i] = mx[i] - mn[i] + 2 * margin;
+	}
+}
+
+array<int, 3> box::num_probes(const float granularity) const
+{
+	const float granularity_inverse = 1.0f / granularity;
+	return {{ static_cast<int>(size[0] * granularity_inverse) + 2, static_cast<int>(size[1] * granularity_inverse) + 2, static_cast<int>(size[2] * granularity_inverse) + 2 }};
+}
+
+size_t box::map_bytes(const float granularity) const
+{
+	const array<int, 3> n = num_probes(granularity);
+	return sizeof(float) * n[0] * n[1] * n[2];
+}
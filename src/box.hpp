@@ -0,0 +1,29 @@
+#pragma once
+#ifndef IDOCK_BOX_HPP
+#define IDOCK_BOX_HPP
+
+#include <array>
+#include <vector>
+#include <string>
+#include <istream>
+using namespace std;
+
+//! Represents an axis-aligned search space fitted tightly to the heavy atoms of a reference ligand or of pocket residues.
+class box
+{
+public:
+	array<float, 3> center; //!< Box center.
+	array<float, 3> size; //!< 3D sizes of box.
+	size_t num_atoms; //!< Number of heavy atoms enclosed.
+
+	//! Fits a box to the heavy atoms of ATOM/HETATM lines in PDBQT format, enlarged by margin on every side. If residues is not empty, only atoms of the given residues, each in the form of chain:sequence or sequence, e.g. A:123 or 123, are considered.
+	explicit box(istream& is, const vector<string>& residues, const float margin);
+
+	//! Returns the number of probes of a grid map of the given granularity, in the same way as receptor does.
+	array<int, 3> num_probes(const float granularity) const;
+
+	//! Returns the number of bytes of a grid map of one atom type of the given granularity.
+	size_t map_bytes(const float granularity) const;
+};
+
+#endif
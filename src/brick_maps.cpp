@@ -0,0 +1,164 @@
+#include <cmath>
+#include <algorithm>
+#include "array.hpp"
+#include "receptor.hpp"
+#include "brick_maps.hpp"
+
+const size_t brick_maps::side;
+const size_t brick_maps::stride1;
+const size_t brick_maps::stride2;
+const size_t brick_maps::brick_elems;
+const float brick_maps::buried_radius = 2.0f;
+const float brick_maps::buried_energy = 10.0f;
+
+brick_maps::brick_maps(const receptor& rec, const scoring_function& sf) : num_bricks({(rec.num_probes[0] + side - 2) / side, (rec.num_probes[1] + side - 2) / side, (rec.num_probes[2] + side - 2) / side}), num_bricks_product(num_bricks[0] * num_bricks[1] * num_bricks[2]), rec(rec), sf(sf), slots(scoring_function::n), empty(brick_elems, 0.0f), buried(brick_elems, buried_energy), num_allocated(0), num_empty(0), num_buried(0)
+{
+	// Bucket the receptor atoms into cells of the cutoff size over their bounding box.
+	array<float, 3> corner1 = rec.corner0;
+	cell_corner = rec.corner0;
+	for (const atom& a : rec.atoms)
+	{
+		for (size_t i = 0; i < 3; ++i)
+		{
+			cell_corner[i] = min(cell_corner[i], a.coord[i]);
+			corner1[i] = max(corner1[i], a.coord[i]);
+		}
+	}
+	for (size_t i = 0; i < 3; ++i)
+	{
+		num_cells[i] = static_cast<size_t>((corner1[i] - cell_corner[i]) / scoring_function::cutoff) + 1;
+	}
+	cells.resize(num_cells[0] * num_cells[1] * num_cells[2]);
+	for (size_t i = 0; i < rec.atoms.size(); ++i)
+	{
+		const array<float, 3>& c = rec.atoms[i].coord;
+		const size_t x = static_cast<size_t>((c[0] - cell_corner[0]) / scoring_function::cutoff);
+		const size_t y = static_cast<size_t>((c[1] - cell_corner[1]) / scoring_function::cutoff);
+		const size_t z = static_cast<size_t>((c[2] - cell_corner[2]) / scoring_function::cutoff);
+		cells[num_cells[0] * (num_cells[1] * z + y) + x].push_back(i);
+	}
+}
+
+brick_maps::~brick_maps()
+{
+	for (const auto& s : slots)
+	{
+		if (!s) continue;
+		for (size_t b = 0; b < num_bricks_product; ++b)
+		{
+			const float* const p = s[b].load(memory_order_relaxed);
+			if (p != empty.data() && p != buried.data()) delete[] p;
+		}
+	}
+}
+
+void brick_maps::enable(const vector<size_t>& xs)
+{
+	for (const size_t t : xs)
+	{
+		if (slots[t]) continue;
+		slots[t].reset(new atomic<const float*>[num_bricks_product]);
+		for (size_t b = 0; b < num_bricks_product; ++b)
+		{
+			slots[t][b].store(nullptr, memory_order_relaxed);
+		}
+	}
+}
+
+size_t brick_maps::count(size_t& num_empty, size_t& num_buried) const
+{
+	num_empty = this->num_empty.load();
+	num_buried = this->num_buried.load();
+	return num_allocated.load();
+}
+
+const float* brick_maps::materialize(const size_t t, const size_t b) const
+{
+	lock_guard<mutex> guard(locks[b % locks.size()]);
+	atomic<const float*>& slot = slots[t][b];
+	if (const float* const p = slot.load(memory_order_relaxed)) return p;
+
+	// Find the bounding box of the probes of the brick.
+	const array<size_t, 3> bi = {{ b % num_bricks[0], b / num_bricks[0] % num_bricks[1], b / (num_bricks[0] * num_bricks[1]) }};
+	array<float, 3> lo, hi, center;
+	for (size_t i = 0; i < 3; ++i)
+	{
+		lo[i] = rec.corner0[i] + rec.granularity * side * bi[i];
+		hi[i] = lo[i] + rec.granularity * side;
+		center[i] = 0.5f * (lo[i] + hi[i]);
+	}
+	const float half_diagonal = 0.5f * sqrt(3.0f) * rec.granularity * side;
+
+	// Collect the receptor atoms within cutoff of the bounding box in ascending order, as populate() accumulates them.
+	vector<size_t> atoms;
+	array<size_t, 3> c0, c1;
+	for (size_t i = 0; i < 3; ++i)
+	{
+		c0[i] = static_cast<size_t>(max((lo[i] - cell_corner[i]) / scoring_function::cutoff - 1, 0.0f));
+		c1[i] = min(static_cast<size_t>(max((hi[i] - cell_corner[i]) / scoring_function::cutoff + 1, 0.0f)), num_cells[i] - 1);
+	}
+	bool is_buried = false;
+	for (size_t z = c0[2]; z <= c1[2]; ++z)
+	for (size_t y = c0[1]; y <= c1[1]; ++y)
+	for (size_t x = c0[0]; x <= c1[0]; ++x)
+	{
+		for (const size_t i : cells[num_cells[0] * (num_cells[1] * z + y) + x])
+		{
+			const array<float, 3>& c = rec.atoms[i].coord;
+			float r2 = 0;
+			for (size_t k = 0; k < 3; ++k)
+			{
+				const float d = c[k] < lo[k] ? lo[k] - c[k] : c[k] > hi[k] ? c[k] - hi[k] : 0;
+				r2 += d * d;
+			}
+			if (r2 >= scoring_function::cutoff_sqr) continue;
+			atoms.push_back(i);
+			if (sqrt(distance_sqr(c, center)) + half_diagonal < buried_radius) is_buried = true;
+		}
+	}
+
+	// Share the brick of zeros or of the repulsive constant, or compute a new brick.
+	const float* p;
+	if (atoms.empty())
+	{
+		p = empty.data();
+		++num_empty;
+	}
+	else if (is_buried)
+	{
+		p = buried.data();
+		++num_buried;
+	}
+	else
+	{
+		sort(atoms.begin(), atoms.end());
+		float* const e = new float[brick_elems]();
+		for (const size_t i : atoms)
+		{
+			const atom& a = rec.atoms[i];
+			const size_t p_offset = sf.nr * mp(a.xs, t);
+			for (size_t z = 0; z < stride1; ++z)
+			{
+				const float dz = lo[2] + rec.granularity * z - a.coord[2];
+				for (size_t y = 0; y < stride1; ++y)
+				{
+					const float dy = lo[1] + rec.granularity * y - a.coord[1];
+					const float dzdy_sqr = dz * dz + dy * dy;
+					if (dzdy_sqr >= scoring_function::cutoff_sqr) continue;
+					float* const row = &e[stride2 * z + stride1 * y];
+					for (size_t x = 0; x < stride1; ++x)
+					{
+						const float dx = lo[0] + rec.granularity * x - a.coord[0];
+						const float r2 = dzdy_sqr + dx * dx;
+						if (r2 >= scoring_function::cutoff_sqr) continue;
+						row[x] += sf.e[p_offset + static_cast<size_t>(sf.ns * r2)];
+					}
+				}
+			}
+		}
+		p = e;
+		++num_allocated;
+	}
+	slot.store(p, memory_order_release);
+	return p;
+}
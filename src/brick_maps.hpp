@@ -0,0 +1,72 @@
+#pragma once
+#ifndef IDOCK_BRICK_MAPS_HPP
+#define IDOCK_BRICK_MAPS_HPP
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "scoring_function.hpp"
+using namespace std;
+
+class receptor;
+
+//! Represents sparse grid maps of a receptor for search spaces too large for dense maps, e.g. a whole protein for blind docking. The probes are grouped into cubic bricks of side probes, each stored with its far faces of (side + 1)^3 probes so that a lookup never crosses bricks. A brick of an atom type is materialized the first time a Monte Carlo task touches it. A brick beyond the cutoff of every receptor atom shares a brick of zeros, and a brick fully buried within a receptor atom shares a brick of a repulsive constant, so that only bricks a ligand may occupy are allocated and computed. Probes are indexed with 64-bit integers.
+class brick_maps
+{
+public:
+	static const size_t side = 8; //!< Number of probe intervals along a side of a brick.
+	static const size_t stride1 = side + 1; //!< Offset between neighboring probes along the Y dimension within a brick.
+	static const size_t stride2 = stride1 * stride1; //!< Offset between neighboring probes along the Z dimension within a brick.
+	static const size_t brick_elems = stride2 * stride1; //!< Number of probes of a brick.
+	static const float buried_radius; //!< Distance to a receptor atom within which a brick is deemed fully buried.
+	static const float buried_energy; //!< Free energy of the probes of a fully buried brick.
+
+	//! Constructs empty sparse maps of a receptor, bucketing its atoms into cells of the cutoff size. The receptor and the precalculated scoring function must outlive the maps.
+	explicit brick_maps(const receptor& rec, const scoring_function& sf);
+
+	//! Frees the materialized bricks.
+	~brick_maps();
+
+	//! Allocates the brick tables of atom types xs that have none. Must not be called while Monte Carlo tasks run.
+	void enable(const vector<size_t>& xs);
+
+	//! Returns true if the brick table of atom type t has been allocated.
+	bool enabled(const size_t t) const
+	{
+		return static_cast<bool>(slots[t]);
+	}
+
+	//! Returns the brick of atom type t containing the probe of indexes (k0, k1, k2), and sets o to the offset of the probe within the brick. Materializes the brick upon first use. Thread safe.
+	const float* lookup(const size_t t, const size_t k0, const size_t k1, const size_t k2, size_t& o) const
+	{
+		const size_t b0 = k0 / side, b1 = k1 / side, b2 = k2 / side;
+		o = stride2 * (k2 - side * b2) + stride1 * (k1 - side * b1) + (k0 - side * b0);
+		const size_t b = num_bricks[0] * (num_bricks[1] * b2 + b1) + b0;
+		const float* const p = slots[t][b].load(memory_order_acquire);
+		return p ? p : materialize(t, b);
+	}
+
+	//! Returns the number of allocated bricks, and sets num_empty and num_buried to the numbers of bricks sharing the brick of zeros and the brick of the repulsive constant respectively.
+	size_t count(size_t& num_empty, size_t& num_buried) const;
+
+	const array<size_t, 3> num_bricks; //!< Number of bricks along the 3 dimensions.
+	const size_t num_bricks_product; //!< Product of num_bricks[0,1,2].
+private:
+	//! Classifies and computes brick b of atom type t under a striped lock, and publishes it to its slot.
+	const float* materialize(const size_t t, const size_t b) const;
+
+	const receptor& rec;
+	const scoring_function& sf;
+	array<float, 3> cell_corner; //!< Corner of the cells of receptor atoms.
+	array<size_t, 3> num_cells; //!< Number of cells along the 3 dimensions.
+	vector<vector<size_t>> cells; //!< Indexes of the receptor atoms of every cell.
+	vector<unique_ptr<atomic<const float*>[]>> slots; //!< Brick pointers of every atom type, null until materialized.
+	const vector<float> empty; //!< Brick of zeros.
+	const vector<float> buried; //!< Brick of the repulsive constant.
+	mutable array<mutex, 64> locks; //!< Striped locks guarding the materialization of bricks.
+	mutable atomic<size_t> num_allocated, num_empty, num_buried;
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include <iomanip>
+#include <sstream>
+#include <limits>
+#include <random>
+#include <algorithm>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include "campaign.hpp"
+
+campaign::campaign(const path& matrix_path)
+{
+	boost::filesystem::ifstream ifs(matrix_path);
+	if (!ifs) throw runtime_error("Job matrix " + matrix_path.string() + " cannot be opened");
+	size_t line_number = 0;
+	for (string line; getline(ifs, line);)
+	{
+		++line_number;
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (line.empty() || line.front() == '#') continue;
+		vector<string> fields;
+		istringstream iss(line);
+		for (string field; getline(iss, field, ',');)
+		{
+			fields.push_back(field);
+		}
+		const string where = " on line " + to_string(line_number) + " of " + matrix_path.string();
+		if (fields.front() == "target" && fields.size() == 9)
+		{
+			campaign_target t;
+			t.name = fields[1];
+			t.receptor_path = fields[2];
+			try
+			{
+				for (size_t i = 0; i < 3; ++i)
+				{
+					t.center[i] = stof(fields[3 + i]);
+					t.size[i] = stof(fields[6 + i]);
+				}
+			}
+			catch (const exception&)
+			{
+				throw runtime_error("Invalid search space" + where);
+			}
+			if (!is_regular_file(t.receptor_path)) throw runtime_error("Receptor " + t.receptor_path.string() + " does not exist or is not a regular file" + where);
+			targets.push_back(move(t));
+		}
+		else if (fields.front() == "library" && fields.size() == 3)
+		{
+			campaign_library l;
+			l.name = fields[1];
+			l.folder = fields[2];
+			if (!is_directory(l.folder)) throw runtime_error("Library folder " + l.folder.string() + " does not exist or is not a directory" + where);
+			libraries.push_back(move(l));
+		}
+		else
+		{
+			throw runtime_error("Expected target,name,receptor,center_x,center_y,center_z,size_x,size_y,size_z or library,name,folder" + where);
+		}
+	}
+	if (targets.empty() || libraries.empty()) throw runtime_error("Job matrix " + matrix_path.string() + " has no targets or no libraries");
+}
+
+void campaign::run(docking_session& session, const docking_options& o, const float granularity, const size_t map_budget, ostream& os, profiler& prof) const
+{
+	// Parse the receptors, and group the targets so that the grid maps of all atom types of a group fit in the map budget.
+	vector<receptor*> receptors;
+	vector<size_t> group_ends;
+	size_t group_bytes = 0;
+	for (size_t i = 0; i < targets.size(); ++i)
+	{
+		const campaign_target& t = targets[i];
+		receptors.push_back(&session.get_receptor(t.receptor_path, t.center, t.size, granularity, os, prof));
+		const size_t bytes = receptors.back()->map_bytes * scoring_function::n;
+		if (map_budget && i && group_bytes + bytes > map_budget)
+		{
+			group_ends.push_back(i);
+			group_bytes = 0;
+		}
+		group_bytes += bytes;
+	}
+	group_ends.push_back(targets.size());
+	os << "Docking " << libraries.size() << " libraries against " << targets.size() << " targets in " << group_ends.size() << " groups" << endl;
+
+	// Collect the ligands of every library, sorted for a stable order.
+	vector<vector<path>> ligands(libraries.size());
+	for (size_t l = 0; l < libraries.size(); ++l)
+	{
+		for (directory_iterator it(libraries[l].folder), end; it != end; ++it)
+		{
+			if (it->path().extension() == ".pdbqt") ligands[l].push_back(it->path());
+		}
+		sort(ligands[l].begin(), ligands[l].end());
+		for (const campaign_target& t : targets)
+		{
+			create_directories(o.output_folder / t.name / libraries[l].name);
+		}
+	}
+
+	// Draw the seed of every ligand from a random number generator seeded once per campaign, in the order of the libraries regardless of the groups.
+	mt19937_64 rng(o.seed);
+	vector<vector<size_t>> seeds(libraries.size());
+	for (size_t l = 0; l < libraries.size(); ++l)
+	{
+		for (size_t i = 0; i < ligands[l].size(); ++i)
+		{
+			seeds[l].push_back(rng());
+		}
+	}
+
+	// Write the conformations of a ligand docked against a target, and output and save its predicted affinities and scores, on the worker pool while the next ligands are docked.
+	vector<log_engine> logs(targets.size());
+	for (log_engine& log : logs)
+	{
+		log.score_names = o.rescorers;
+	}
+	safe_counter<size_t> wcnt;
+	wcnt.init(numeric_limits<size_t>::max());
+	safe_function safe_print;
+	size_t index = 0;
+	const function<void(shared_ptr<const ligand>, docking_result, size_t, size_t, ligand_record)> write = [&](shared_ptr<const ligand> lig, docking_result r, const size_t t, const size_t l, ligand_record lr)
+	{
+		const stopwatch sw;
+		boost::filesystem::ofstream ofs(o.output_folder / targets[t].name / libraries[l].name / lig->filename);
+		lig->write(ofs, r.conformations);
+		lr.write = sw.elapsed();
+		prof.add_ligand(move(lr));
+
+		// Output and save ligand stem, predicted affinities and scores.
+		vector<float> affinities;
+		vector<vector<float>> scores;
+		affinities.reserve(o.max_conformations);
+		for (const solution& c : r.conformations)
+		{
+			affinities.push_back(c.e);
+			scores.push_back(c.scores);
+		}
+		const string stem = lig->filename.stem().string();
+		safe_print([&]()
+		{
+			os << setw(8) << ++index << setw(14) << stem << setw(14) << targets[t].name << "   ";
+			for_each(affinities.cbegin(), affinities.cbegin() + min<size_t>(affinities.size(), 9), [&os](const float a)
+			{
+				os << setw(6) << a;
+			});
+			os << endl;
+			logs[t].push_back(new log_record(libraries[l].name + '/' + stem, move(affinities), r.statistics, move(scores)));
+		});
+		wcnt.increment();
+	};
+
+	// Dock every ligand against the targets of a group in turn, parsing it once per group. Wait until the posted writes have completed before returning, also when parsing a ligand throws, as they refer to the locals of this function.
+	size_t num_posted = 0;
+	const safe_counter_guard<size_t> guard(wcnt, num_posted);
+	docking_options lo = o;
+	os.setf(ios::fixed, ios::floatfield);
+	os << "   Index        Ligand        Target    pKd 1     2     3     4     5     6     7     8     9" << endl << setprecision(2);
+	for (size_t g = 0, t0 = 0; g < group_ends.size(); t0 = group_ends[g++])
+	{
+		for (size_t l = 0; l < libraries.size(); ++l)
+		{
+			for (size_t i = 0; i < ligands[l].size(); ++i)
+			{
+				const path& p = ligands[l][i];
+				stopwatch sw;
+				const shared_ptr<const ligand> lig = make_shared<const ligand>(p);
+				const double parse = sw.elapsed();
+				lo.seed = seeds[l][i];
+				for (size_t t = t0; t < group_ends[g]; ++t)
+				{
+					sw = stopwatch();
+					docking_result r = session.dock(*receptors[t], *lig, lo, nullptr, &prof);
+					const double dock = sw.elapsed();
+					const size_t evaluations = r.statistics.evaluations;
+					++num_posted;
+					session.post(bind(write, lig, move(r), t, l, ligand_record{ targets[t].name + '/' + libraries[l].name + '/' + p.stem().string(), t == t0 ? parse : 0, dock, 0, evaluations }));
+				}
+			}
+		}
+	}
+	wcnt.wait(num_posted);
+
+	// Sort and write the log records of every target to its log file.
+	for (size_t t = 0; t < targets.size(); ++t)
+	{
+		log_engine& log = logs[t];
+		if (log.empty()) continue;
+		const path log_path = o.output_folder / targets[t].name / "log.csv";
+		os << "Writing log records of " << log.size() << " ligands to " << log_path << endl;
+		log.sort();
+		log.write(log_path);
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef IDOCK_CAMPAIGN_HPP
+#define IDOCK_CAMPAIGN_HPP
+
+#include "docking_session.hpp"
+
+//! Represents a target of a campaign, i.e. a receptor and a search space.
+class campaign_target
+{
+public:
+	string name; //!< Name of the target, which names its output folder.
+	path receptor_path; //!< Receptor in PDBQT format.
+	array<float, 3> center; //!< Search space center.
+	array<float, 3> size; //!< Search space size.
+};
+
+//! Represents a ligand library of a campaign.
+class campaign_library
+{
+public:
+	string name; //!< Name of the library, which names its output folders.
+	path folder; //!< Folder of ligands in PDBQT format.
+};
+
+//! Represents a campaign of docking every library of a job matrix against every target. Targets are grouped so that the grid maps of a group fit in the map budget, and within a group every ligand is parsed once and docked against all the targets of the group in turn, so that ligands are parsed once per group and grid maps stay resident.
+class campaign
+{
+public:
+	//! Parses a job matrix of one target or library per line in csv format, i.e. target,name,receptor,center_x,center_y,center_z,size_x,size_y,size_z or library,name,folder. Empty lines and lines starting with # are skipped. Throws runtime_error on a malformed line or a missing file.
+	explicit campaign(const path& matrix_path);
+
+	//! Docks every library against every target with options o, whose output folder receives a folder per target holding a folder per library of output ligands and a log.csv of the target. Groups targets by their grid maps of all atom types at granularity within map_budget bytes, or all in one group if 0. Every ligand is docked with its own seed drawn from o.seed, and written on the worker pool of the session while the next ones are docked.
+	void run(docking_session& session, const docking_options& o, const float granularity, const size_t map_budget, ostream& os, profiler& prof) const;
+
+	vector<campaign_target> targets; //!< Targets in the order of the job matrix.
+	vector<campaign_library> libraries; //!< Libraries in the order of the job matrix.
+};
+
+#endif
@@ -0,0 +1,584 @@
+#include <cmath>
+#include <limits>
+#include <iomanip>
+#include <sstream>
+#include "kernel.hpp"
+#include "tracer.hpp"
+#include "result_cache.hpp"
+#include "warm_start.hpp"
+#include "brick_maps.hpp"
+#include "docking_session.hpp"
+
+docking_session::docking_session(const size_t num_threads, const bool pin, const size_t num_trees, const size_t seed, ostream& os, profiler& prof, const size_t map_budget, const path& map_folder) : num_threads(num_threads), io(num_threads, pin), f(num_trees, seed), maps(map_budget, map_folder)
+{
+	os << "Creating an io service pool of " << num_threads << (pin ? " pinned" : "") << " worker threads" << endl;
+	if (map_budget) os << "Keeping grid maps within " << map_budget / 1048576 << " MB" << (map_folder.empty() ? "" : ", spilling evicted ones to " + map_folder.string()) << endl;
+
+	os << "Precalculating a scoring function of " << scoring_function::n << " atom types in parallel" << endl;
+	stopwatch sw;
+	cnt.init((sf.n + 1) * sf.n >> 1);
+	for (size_t t1 = 0; t1 < sf.n; ++t1)
+	for (size_t t0 = 0; t0 <=  t1; ++t0)
+	{
+		io.post([&, t0, t1]()
+		{
+			const stopwatch task_sw;
+			trace_scope ts("precalculate");
+			sf.precalculate(t0, t1);
+			busy.add(task_sw);
+			cnt.increment();
+		});
+	}
+	cnt.wait();
+	sf.clear();
+	prof.add_stage("Precalculating scoring function", sw.elapsed(), busy.reset(), (sf.n + 1) * sf.n >> 1);
+
+	os << "Training a random forest of " << num_trees << " trees in parallel" << endl;
+	sw = stopwatch();
+	cnt.init(num_trees);
+	for (size_t i = 0; i < num_trees; ++i)
+	{
+		io.post([&, i]()
+		{
+			const stopwatch task_sw;
+			trace_scope ts("train");
+			f[i].train(4, f.seed(i));
+			busy.add(task_sw);
+			cnt.increment();
+		});
+	}
+	cnt.wait();
+	f.clear();
+	prof.add_stage("Training random forest", sw.elapsed(), busy.reset(), num_trees);
+}
+
+docking_session::~docking_session()
+{
+	io.wait();
+}
+
+void docking_session::release(const receptor& rec)
+{
+	maps.release(rec);
+	if (rec.coarse) maps.release(*rec.coarse);
+}
+
+receptor& docking_session::get_receptor(const path& receptor_path, const array<float, 3>& center, const array<float, 3>& size, const float granularity, ostream& os, profiler& prof)
+{
+	ostringstream key;
+	key << receptor_path.string() << ' ' << center[0] << ' ' << center[1] << ' ' << center[2] << ' ' << size[0] << ' ' << size[1] << ' ' << size[2] << ' ' << granularity;
+	unique_ptr<receptor>& rec = receptors[key.str()];
+	if (rec) return *rec;
+
+	os << "Parsing receptor " << receptor_path << endl;
+	const stopwatch sw;
+	rec.reset(new receptor(receptor_path, center, size, granularity));
+	prof.add_stage("Parsing receptor", sw.elapsed(), 0, 0);
+	os.setf(ios::fixed, ios::floatfield);
+	os << "Using a search space of center (" << setprecision(3) << center[0] << ", " << center[1] << ", " << center[2] << ") and size (" << size[0] << ", " << size[1] << ", " << size[2] << ")" << endl
+	   << "Grid maps of " << rec->num_probes[0] << " x " << rec->num_probes[1] << " x " << rec->num_probes[2] << " probes take " << setprecision(1) << rec->map_bytes / 1048576.0 << " MB per atom type" << endl;
+	return *rec;
+}
+
+void docking_session::dock(receptor& rec, const function<bool(path&)>& next_ligand, const docking_options& o, ostream& os, log_engine& log, profiler& prof)
+{
+	prepare_maps(rec, o);
+	vector<int>   ligh(2601);
+	vector<float> slnd(3438 * o.num_tasks);
+	vector<search_statistics> stats(o.num_tasks);
+
+	// Perform docking for each ligand.
+	const stopwatch docking_sw;
+	stopwatch sw;
+	safe_counter<size_t> wcnt;
+	wcnt.init(numeric_limits<size_t>::max());
+	size_t num_ligands = 0;
+	busy_accumulator docking_busy;
+	size_t docking_tasks = 0;
+	double maps_wall = 0;
+	os.setf(ios::fixed, ios::floatfield);
+
+	// Rescore the conformations by the requested scorers, whose scores follow the predicted binding affinities in the log.
+	const rescoring rs(o.rescorers, f, sf);
+	log.score_names = rs.names();
+
+	// Report the bricks of the sparse maps materialized so far if any.
+	const auto report_bricks = [&]()
+	{
+		if (!rec.bricks) return;
+		size_t num_empty, num_buried;
+		const size_t num_allocated = rec.bricks->count(num_empty, num_buried);
+		os << "Materialized " << num_allocated << " bricks of sparse grid maps taking " << setprecision(1) << num_allocated * sizeof(float) * brick_maps::brick_elems / 1048576.0 << " MB, and shared " << num_empty << " empty and " << num_buried << " buried bricks" << endl;
+	};
+
+	// In latency mode, dock one ligand at a time with all workers, rewriting its output file whenever its top conformation improves.
+	if (o.latency)
+	{
+		os << "Executing up to " << o.num_tasks << " optimization runs of " << o.num_bfgs_iterations << " BFGS iterations in rounds of " << num_threads << endl
+		   << "   Index        Ligand    pKd 1     2     3     4     5     6     7     8     9" << endl << setprecision(2);
+		for (path input_ligand_path; next_ligand(input_ligand_path);)
+		{
+			sw = stopwatch();
+			const ligand lig(input_ligand_path);
+			ligand_record lr = { input_ligand_path.stem().string(), sw.elapsed(), 0, 0, 0 };
+
+			// Create grid maps on the fly if necessary.
+			sw = stopwatch();
+			if (const size_t num_types = create_maps(rec, lig))
+			{
+				maps_wall += sw.elapsed();
+				prof.add_stage("Creating grid maps of " + to_string(num_types) + " atom types", sw.elapsed(), busy.reset(), rec.num_probes[2]);
+			}
+
+			// Search, and stream the best conformations to the output file and the progress to os as they improve.
+			sw = stopwatch();
+			const path output_ligand_path = o.output_folder / lig.filename;
+			const docking_result r = search(rec, lig, o, [&](const docking_result& r)
+			{
+				const stopwatch write_sw;
+				boost::filesystem::ofstream ofs(output_ligand_path);
+				lig.write(ofs, r.conformations);
+				os << setw(8) << "" << setw(14) << lr.stem << "    improved to " << r.conformations.front().e << " after " << r.num_tasks << " tasks" << endl;
+				lr.write += write_sw.elapsed();
+			}, docking_busy);
+			lr.dock = sw.elapsed() - lr.write;
+
+			// Write the final conformations, as later rounds may have changed those after the top one or the clustering without improving the top one.
+			sw = stopwatch();
+			{
+				boost::filesystem::ofstream ofs(output_ligand_path);
+				lig.write(ofs, r.conformations);
+			}
+			lr.write += sw.elapsed();
+			lr.evaluations = r.statistics.evaluations;
+			docking_tasks += r.num_tasks;
+			++num_ligands;
+
+			// Output and save ligand stem, predicted affinities and scores.
+			vector<float> affinities;
+			vector<vector<float>> scores;
+			for (const solution& c : r.conformations)
+			{
+				affinities.push_back(c.e);
+				scores.push_back(c.scores);
+			}
+			os << setw(8) << log.size() + 1 << setw(14) << lr.stem << setw(2) << "   ";
+			for_each(affinities.cbegin(), affinities.cbegin() + min<size_t>(affinities.size(), 9), [&os](const float a)
+			{
+				os << setw(6) << a;
+			});
+			os << endl;
+			log.push_back(new log_record(string(lr.stem), move(affinities), r.statistics, move(scores)));
+			prof.add_ligand(move(lr));
+		}
+		report_bricks();
+		prof.add_stage("Docking ligands", docking_sw.elapsed() - maps_wall, docking_busy.reset(), docking_tasks);
+		return;
+	}
+
+	// Keep the best ROOT poses of the docked ligands to warm start their analogs if requested.
+	unique_ptr<pose_library> library;
+	size_t num_warm_ligands = 0;
+	if (o.warm_start > 0) library.reset(new pose_library(o.max_conformations));
+
+	// Open the result cache if requested.
+	unique_ptr<result_cache> cache;
+	size_t rec_hash = 0, num_hits = 0;
+	if (!o.cache_folder.empty())
+	{
+		cache.reset(new result_cache(o.cache_folder));
+		rec_hash = result_cache::hash(rec);
+	}
+
+	// Write the conformations of a ligand and of its duplicates, storing them to the cache under a key unless the key is empty, and output and save their predicted affinities.
+	const function<void(ligand, vector<float>, ligand_record, const search_statistics&, const string&, const vector<path>&)> write = [&](ligand lig, vector<float> cnfh, ligand_record lr, const search_statistics& st, const string& key, const vector<path>& duplicates)
+	{
+		const auto output = [&](ligand& lig)
+		{
+			safe_print([&]()
+			{
+				string stem = lig.filename.stem().string();
+				os << setw(8) << log.size() + 1 << setw(14) << stem << setw(2) << "   ";
+				for_each(lig.affinities.cbegin(), lig.affinities.cbegin() + min<size_t>(lig.affinities.size(), 9), [&os](const float a)
+				{
+					os << setw(6) << a;
+				});
+				os << endl;
+				log.push_back(new log_record(move(stem), move(lig.affinities), st, move(lig.scores)));
+			});
+		};
+
+		// Write conformations.
+		const stopwatch task_sw;
+		trace_scope ts("write");
+		if (!key.empty()) cache->store(key, cnfh, st);
+		lig.write(cnfh.data(), o.output_folder, o.max_conformations, o.num_tasks, rec, rs);
+		lr.write = task_sw.elapsed();
+		prof.add_ligand(move(lr));
+
+		// Output and save ligand stem and predicted affinities.
+		output(lig);
+
+		// Fan the conformations out to the duplicates of the ligand.
+		for (const path& p : duplicates)
+		{
+			const stopwatch duplicate_sw;
+			ligand duplicate(p);
+			duplicate.write(cnfh.data(), o.output_folder, o.max_conformations, o.num_tasks, rec, rs);
+			prof.add_ligand({ p.stem().string(), 0, 0, duplicate_sw.elapsed(), 0 });
+			output(duplicate);
+		}
+		docking_busy.add(task_sw);
+		wcnt.increment();
+	};
+
+	// Wait until the posted writes have completed before returning, also when parsing a ligand throws, as they refer to the locals of this function.
+	size_t num_posted = 0;
+	const safe_counter_guard<size_t> guard(wcnt, num_posted);
+
+	// Detect duplicate ligands in a pre-pass if requested. Only the first ligand of each group of identical encodings is docked, and its conformations are fanned out to the others. Only the paths of the ligands are kept, so that the memory of the pre-pass does not grow with the size of the ligands, and the first ligands are parsed again for docking.
+	vector<pair<path, vector<path>>> groups;
+	size_t num_duplicates = 0;
+	if (o.deduplicate)
+	{
+		// Group the ligands by the hash of their encodings, and compare the encodings themselves on equal hashes, parsing the first ligands of the candidate groups again, so that a hash collision does not merge different ligands.
+		map<size_t, vector<size_t>> representatives;
+		vector<int> encoding, other;
+		for (path p; next_ligand(p);)
+		{
+			const ligand lig(p);
+			encoding.resize(lig.get_lig_elems());
+			lig.encode(encoding.data());
+			vector<size_t>& candidates = representatives[lig.hash()];
+			const auto it = find_if(candidates.cbegin(), candidates.cend(), [&](const size_t i)
+			{
+				const ligand r(groups[i].first);
+				other.resize(r.get_lig_elems());
+				r.encode(other.data());
+				return other == encoding;
+			});
+			if (it == candidates.cend())
+			{
+				candidates.push_back(groups.size());
+				groups.emplace_back(move(p), vector<path>());
+			}
+			else
+			{
+				groups[*it].second.push_back(move(p));
+				++num_duplicates;
+			}
+		}
+		os << "Found " << num_duplicates << " duplicates among " << groups.size() + num_duplicates << " ligands" << endl;
+	}
+	size_t g = 0;
+	const function<bool(path&)> next = [&](path& p)
+	{
+		if (!o.deduplicate) return next_ligand(p);
+		if (g == groups.size()) return false;
+		p = groups[g++].first;
+		return true;
+	};
+
+	os << "Executing " << o.num_tasks << " optimization runs of " << o.num_bfgs_iterations << " BFGS iterations in parallel" << endl
+	   << "   Index        Ligand    pKd 1     2     3     4     5     6     7     8     9" << endl << setprecision(2);
+	for (path input_ligand_path; next(input_ligand_path);)
+	{
+		// Parse the ligand. Don't declare it const as it will be moved to the callback data wrapper.
+		sw = stopwatch();
+		const double trace_t0 = tracer::enabled() ? tracer::now() : 0;
+		ligand lig(input_ligand_path);
+		if (tracer::enabled()) tracer::record("parse ligand", trace_t0);
+		ligand_record lr = { input_ligand_path.stem().string(), sw.elapsed(), 0, 0, 0 };
+		vector<path> duplicates;
+		if (o.deduplicate) duplicates = move(groups[g - 1].second);
+
+		// Reallocate ligh and ligd should the current ligand elements exceed the default size.
+		const size_t this_lig_elems = lig.get_lig_elems();
+		if (this_lig_elems > ligh.size())
+		{
+			ligh.resize(this_lig_elems);
+		}
+
+		// Encode the current ligand.
+		sw = stopwatch();
+		{
+			trace_scope ts("encode ligand");
+			lig.encode(ligh.data());
+		}
+		lr.parse += sw.elapsed();
+		++num_ligands;
+
+		// Start a fraction of the tasks from the best ROOT poses of a docked analog if any.
+		vector<array<float, 7>> warm;
+		size_t num_warm = 0;
+		if (library)
+		{
+			warm = library->align(lig);
+			if (!warm.empty())
+			{
+				num_warm = min(static_cast<size_t>(o.warm_start * o.num_tasks + 0.5f), o.num_tasks);
+				++num_warm_ligands;
+			}
+		}
+
+		// Seed the tasks of the ligand from the seed and the ligand itself regardless of its position in the batch, so that a result cached in another run is the result of docking it in this run.
+		mt19937_64 rng(seed_of(lig, o));
+
+		// Look up the cache, skipping the grid maps and the Monte Carlo tasks on a hit. Warm started ligands neither look up nor store results, as they depend on the previously docked ligands, so that they are docked as without the cache too.
+		const size_t this_cnf_elems = lig.get_cnf_elems() * o.num_tasks;
+		string key;
+		vector<float> cnfh;
+		search_statistics st;
+		if (cache && !num_warm)
+		{
+			key = result_cache::key(rec_hash, ligh.data(), this_lig_elems, o.num_tasks, o.num_bfgs_iterations, o.coarse_generations, o.coarse_granularity, o.seed);
+			if (cache->load(key, cnfh, st) && cnfh.size() == this_cnf_elems)
+			{
+				++num_hits;
+				if (library) library->add(lig, cnfh.data(), o.num_tasks);
+				++docking_tasks;
+				++num_posted;
+				io.post(bind(write, move(lig), move(cnfh), move(lr), st, string(), move(duplicates)));
+				continue;
+			}
+		}
+
+		// Create grid maps on the fly if necessary.
+		sw = stopwatch();
+		if (const size_t num_types = create_maps(rec, lig))
+		{
+			maps_wall += sw.elapsed();
+			prof.add_stage("Creating grid maps of " + to_string(num_types) + " atom types", sw.elapsed(), busy.reset(), rec.num_probes[2]);
+		}
+
+		// Reallocate slnd should the current solution elements exceed the default size.
+		const size_t this_sln_elems = lig.get_sln_elems() * o.num_tasks;
+		if (this_sln_elems > slnd.size())
+		{
+			slnd.resize(this_sln_elems);
+		}
+
+		// Clear the solution buffer.
+		slnd.assign(slnd.size(), 0);
+
+		// Launch kernel, reporting the provisional top conformations while the tasks run if requested.
+		sw = stopwatch();
+		if (o.report_interval)
+		{
+			progress_board board(o.num_tasks, lig.nv, o.report_interval);
+			const progress_reporter reporter(board, std::chrono::milliseconds(100), [&]()
+			{
+				vector<float> ex;
+				const size_t n = board.snapshot(ex);
+				const vector<solution> conformations = lig.cluster(ex.data(), o.max_conformations, n, n, rec, rescoring());
+				if (o.report_poses)
+				{
+					boost::filesystem::ofstream ofs(o.output_folder / lig.filename);
+					lig.write(ofs, conformations);
+				}
+				safe_print([&]()
+				{
+					os << setw(8) << "" << setw(14) << lr.stem << setw(2) << "   ";
+					for (size_t i = 0; i < min<size_t>(conformations.size(), 9); ++i)
+					{
+						os << setw(6) << conformations[i].e;
+					}
+					os << "   provisional of " << n << " tasks" << endl;
+				});
+			});
+			run_tasks(rec, lig, ligh.data(), slnd.data(), stats, 0, o.num_tasks, o, rng, docking_busy, &board, warm, num_warm);
+		}
+		else
+		{
+			run_tasks(rec, lig, ligh.data(), slnd.data(), stats, 0, o.num_tasks, o, rng, docking_busy, nullptr, warm, num_warm);
+		}
+		lr.dock = sw.elapsed();
+		if (library) library->add(lig, slnd.data(), o.num_tasks);
+
+		// Aggregate the search statistics of the tasks.
+		for (const auto& t : stats)
+		{
+			st += t;
+		}
+		lr.evaluations = st.evaluations;
+		docking_tasks += o.num_tasks + 1;
+		++num_posted;
+		io.post(bind(write, move(lig), vector<float>(slnd.cbegin(), slnd.cbegin() + this_cnf_elems), move(lr), st, move(key), move(duplicates)));
+	}
+
+	// Wait until all the ligands have been written.
+	wcnt.wait(num_posted);
+	if (cache) os << "Reused cached results of " << num_hits << " of " << num_ligands << " ligands" << endl;
+	report_bricks();
+	if (maps.budget) os << "Grid maps take " << maps.bytes() / 1048576 << " MB of a budget of " << maps.budget / 1048576 << " MB after " << maps.num_evictions << " evictions and " << maps.num_reloads << " reloads" << endl;
+	if (library) os << "Warm started " << num_warm_ligands << " of " << num_ligands << " ligands from the poses of their analogs" << endl;
+	prof.add_stage("Docking ligands", docking_sw.elapsed() - maps_wall, docking_busy.reset(), docking_tasks);
+}
+
+docking_result docking_session::dock(receptor& rec, const ligand& lig, const docking_options& o, const function<void(const docking_result&)>& improved, profiler* const prof)
+{
+	prepare_maps(rec, o);
+	const stopwatch sw;
+	const size_t num_types = create_maps(rec, lig);
+	if (num_types && prof) prof->add_stage("Creating grid maps of " + to_string(num_types) + " atom types", sw.elapsed(), busy.reset(), rec.num_probes[2]);
+	busy.reset();
+	busy_accumulator task_busy;
+	return search(rec, lig, o, improved, task_busy);
+}
+
+size_t docking_session::seed_of(const ligand& lig, const docking_options& o)
+{
+	return o.seed ^ lig.hash();
+}
+
+void docking_session::post(const function<void()>& work)
+{
+	io.post(work);
+}
+
+void docking_session::prepare_maps(receptor& rec, const docking_options& o)
+{
+	if (rec.coarse && (!o.coarse_generations || rec.coarse->granularity != o.coarse_granularity))
+	{
+		maps.release(*rec.coarse);
+		rec.coarse.reset();
+	}
+	if (o.coarse_generations && !rec.coarse)
+	{
+		rec.coarse.reset(new receptor(rec, o.coarse_granularity));
+	}
+	if (!o.sparse)
+	{
+		rec.bricks.reset();
+	}
+	else if (!rec.bricks)
+	{
+		maps.release(rec);
+		rec.maps.assign(sf.n, vector<float>());
+		rec.bricks.reset(new brick_maps(rec, sf));
+	}
+}
+
+size_t docking_session::create_maps(receptor& rec, const ligand& lig)
+{
+	// Enable the atom types of lig in the sparse maps if any, whose bricks are computed by the Monte Carlo tasks as they touch them.
+	if (rec.bricks)
+	{
+		vector<size_t> xs;
+		for (size_t t = 0; t < sf.n; ++t)
+		{
+			if (lig.xs[t] && !rec.bricks->enabled(t)) xs.push_back(t);
+		}
+		rec.bricks->enable(xs);
+	}
+
+	// Find atom types that are presented in the current ligand.
+	vector<size_t> lig_xs;
+	for (size_t t = 0; t < sf.n; ++t)
+	{
+		if (lig.xs[t]) lig_xs.push_back(t);
+	}
+
+	vector<bool> created(sf.n);
+	maps.begin();
+	for (receptor* const r : { rec.bricks ? nullptr : &rec, rec.coarse.get() })
+	{
+		if (!r) continue;
+
+		// Find atom types whose grid maps are neither present nor reloaded within the map budget.
+		const vector<size_t> xs = maps.acquire(*r, lig_xs);
+		for (const size_t t : xs)
+		{
+			r->maps[t].resize(r->num_probes_product);
+			created[t] = true;
+		}
+		if (xs.empty()) continue;
+
+		// Precalculate p_offset.
+		r->precalculate(sf, xs);
+
+		// Create grid maps in parallel.
+		cnt.init(r->num_probes[2]);
+		for (size_t z = 0; z < r->num_probes[2]; ++z)
+		{
+			io.post([&, r, z]()
+			{
+				const stopwatch task_sw;
+				trace_scope ts("populate");
+				r->populate(xs, z, sf);
+				busy.add(task_sw);
+				cnt.increment();
+			});
+		}
+		cnt.wait();
+	}
+	return count(created.cbegin(), created.cend(), true);
+}
+
+void docking_session::run_tasks(const receptor& rec, const ligand& lig, const int* const ligh, float* const slnd, vector<search_statistics>& stats, const size_t gid0, const size_t gid1, const docking_options& o, mt19937_64& rng, busy_accumulator& task_busy, progress_board* const board, const vector<array<float, 7>>& warm, const size_t num_warm)
+{
+	const receptor& c = rec.coarse ? *rec.coarse : rec;
+	cnt.init(gid1 - gid0);
+	for (size_t gid = gid0; gid < gid1; ++gid)
+	{
+		const size_t s = rng();
+		stats[gid] = search_statistics();
+		const float* const w = gid < num_warm ? warm[gid % warm.size()].data() : nullptr;
+		io.post([&, s, gid, w]()
+		{
+			const stopwatch task_sw;
+			trace_scope ts("monte_carlo");
+			monte_carlo(slnd, ligh, lig.nv, lig.nf, lig.na, lig.np, s, o.num_bfgs_iterations, sf.e.data(), sf.d.data(), sf.ns, rec.corner0, rec.corner1, rec.num_probes, rec.granularity_inverse, rec.maps, rec.bricks.get(), o.coarse_generations, c.num_probes, c.granularity_inverse, c.maps, gid, o.num_tasks, stats[gid], board, w);
+			task_busy.add(task_sw);
+			cnt.increment();
+		});
+	}
+	cnt.wait();
+}
+
+docking_result docking_session::search(const receptor& rec, const ligand& lig, const docking_options& o, const function<void(const docking_result&)>& improved, busy_accumulator& task_busy)
+{
+	// Encode the ligand, and seed its tasks as in a batch, so that a run stopped early sees a prefix of the tasks of a full run.
+	mt19937_64 rng(seed_of(lig, o));
+	vector<int> ligh(lig.get_lig_elems());
+	lig.encode(ligh.data());
+	vector<float> slnd(lig.get_sln_elems() * o.num_tasks);
+	vector<search_statistics> stats(o.num_tasks);
+	const rescoring rs(o.rescorers, f, sf);
+
+	// In latency mode, run one task per worker per round, and recluster after every round to track the free energies of the top 3 conformations.
+	const size_t round = o.latency ? num_threads : o.num_tasks;
+	const size_t num_top = min<size_t>(o.max_conformations, 3);
+	docking_result r;
+	vector<float> top;
+	size_t stable = 0;
+	for (size_t gid0 = 0; gid0 < o.num_tasks;)
+	{
+		const size_t gid1 = min(gid0 + round, o.num_tasks);
+		run_tasks(rec, lig, ligh.data(), slnd.data(), stats, gid0, gid1, o, rng, task_busy);
+		r.conformations = lig.cluster(slnd.data(), o.max_conformations, o.num_tasks, gid1, rec, rs);
+		r.num_tasks = gid1;
+
+		// Count the tasks over which the top free energies have not changed by 0.01, the precision of the output.
+		vector<float> t;
+		for (size_t i = 0; i < min(num_top, r.conformations.size()); ++i)
+		{
+			t.push_back(r.conformations[i].e);
+		}
+		bool changed = t.size() != top.size();
+		for (size_t i = 0; i < t.size() && !changed; ++i)
+		{
+			changed = fabs(t[i] - top[i]) >= 0.01f;
+		}
+		stable = changed ? 0 : stable + gid1 - gid0;
+		for (size_t i = gid0; i < gid1; ++i)
+		{
+			r.statistics += stats[i];
+		}
+		if (improved && !t.empty() && (top.empty() || t.front() < top.front())) improved(r);
+		top = move(t);
+		gid0 = gid1;
+		if (o.latency && o.patience && stable >= o.patience) break;
+	}
+	return r;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef IDOCK_DOCKING_SESSION_HPP
+#define IDOCK_DOCKING_SESSION_HPP
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include "io_service_pool.hpp"
+#include "safe_class.hpp"
+#include "random_forest.hpp"
+#include "receptor.hpp"
+#include "ligand.hpp"
+#include "log.hpp"
+#include "profiler.hpp"
+#include "progress_board.hpp"
+#include "map_manager.hpp"
+
+//! Represents the parameters of docking a batch of ligands.
+class docking_options
+{
+public:
+	path output_folder; //!< Folder of output ligands in PDBQT format.
+	size_t num_tasks; //!< Number of Monte Carlo tasks per ligand.
+	size_t num_bfgs_iterations; //!< Number of generations in BFGS.
+	size_t max_conformations; //!< Maximum number of binding conformations to write.
+	size_t seed; //!< Random seed, from which the Monte Carlo tasks of every ligand are seeded along with the hash of the ligand encoding.
+	bool latency; //!< Docks one ligand at a time in rounds of one Monte Carlo task per worker, writing its best conformations as they improve.
+	size_t patience; //!< In latency mode, stops early once the free energies of the top conformations have not changed over this many tasks, or never if 0.
+	size_t report_interval; //!< Generations between publications of the best conformation of every task for provisional reports while a ligand is docked, or 0 to disable.
+	bool report_poses; //!< Writes the provisional conformations to the output file along with the provisional reports.
+	path cache_folder; //!< Folder of the cross-run result cache, or empty to disable it.
+	bool deduplicate; //!< Docks only the first of the ligands of identical encodings, and writes its conformations for the others.
+	float warm_start; //!< Fraction of the Monte Carlo tasks of a ligand started from the best ROOT poses of the last docked ligand of the same ROOT atom types and geometry, or 0 to start all tasks randomly. Applies to batches out of latency mode.
+	size_t coarse_generations; //!< Number of early generations of every Monte Carlo task searched on coarse grid maps before refining on the fine ones, fewer than num_bfgs_iterations, or 0 to search on the fine maps only.
+	float coarse_granularity; //!< Granularity of the coarse grid maps.
+	bool sparse; //!< Uses sparse grid maps of bricks materialized as the Monte Carlo tasks touch them in place of dense fine grid maps, e.g. for blind docking over a whole protein.
+	vector<string> rescorers; //!< Names of the built-in scorers to rescore the written conformations by for consensus ranking, or empty to disable rescoring.
+};
+
+//! Represents the docking result of a ligand.
+class docking_result
+{
+public:
+	vector<solution> conformations; //!< Predicted conformations in ascending order of free energy, clustered with an RMSD of 2 Angstrom.
+	search_statistics statistics; //!< Search statistics aggregated over the Monte Carlo tasks.
+	size_t num_tasks; //!< Number of Monte Carlo tasks run, fewer than requested if stopped early.
+};
+
+//! Represents a docking session that keeps a worker pool, a precalculated scoring function, a trained random forest, and parsed receptors with their grid maps warm across batches of ligands.
+class docking_session
+{
+public:
+	//! Creates a pool of optionally pinned worker threads, precalculates the scoring function and trains the random forest in parallel, reporting progress to os and timings to prof. Dense grid maps of all receptors are kept within map_budget bytes, evicting the least recently used ones to map_folder if not empty, or unlimited if map_budget is 0.
+	explicit docking_session(const size_t num_threads, const bool pin, const size_t num_trees, const size_t seed, ostream& os, profiler& prof, const size_t map_budget = 0, const path& map_folder = path());
+
+	//! Waits for the posted work to complete and stops the worker threads.
+	~docking_session();
+
+	//! Returns the receptor of a search space, parsing it upon first use and keeping it with its grid maps for subsequent batches.
+	receptor& get_receptor(const path& receptor_path, const array<float, 3>& center, const array<float, 3>& size, const float granularity, ostream& os, profiler& prof);
+
+	//! Docks the ligands returned by next_ligand against rec, creating missing grid maps on the fly, and appends their log records. Returns after all the ligands have been written. Batches must not be docked concurrently.
+	void dock(receptor& rec, const function<bool(path&)>& next_ligand, const docking_options& o, ostream& os, log_engine& log, profiler& prof);
+
+	//! Docks a ligand against rec in memory, creating missing grid maps on the fly, and returns its conformations without writing files. Output folder of o is ignored. In latency mode, improved is called with the current result whenever the top conformation improves. Records the creation of grid maps to prof if not null. Must not be called concurrently with other docking calls.
+	docking_result dock(receptor& rec, const ligand& lig, const docking_options& o, const function<void(const docking_result&)>& improved = nullptr, profiler* const prof = nullptr);
+
+	//! Posts work to the worker pool, e.g. writing a docked ligand while the next one is docked. The caller must wait for the work to complete.
+	void post(const function<void()>& work);
+
+	//! Stops tracking the grid maps of rec and of its coarse receptor against the map budget. Must be called before destroying a receptor docked against with a map budget, unless the session is destroyed first.
+	void release(const receptor& rec);
+
+	const size_t num_threads; //!< Number of worker threads.
+private:
+	//! Attaches to rec a coarse receptor of the granularity of o if coarse generations are requested, and sparse maps if requested, detaching those not requested.
+	void prepare_maps(receptor& rec, const docking_options& o);
+
+	//! Creates the dense grid maps of the atom types of lig that are missing from rec and from its coarse receptor if any in parallel, and returns the number of atom types created. Sparse maps of rec only get their atom types enabled.
+	size_t create_maps(receptor& rec, const ligand& lig);
+
+	//! Returns the seed of the Monte Carlo tasks of lig, derived from the seed of o and the hash of the ligand encoding, so that a ligand is docked alike wherever it appears in a batch.
+	static size_t seed_of(const ligand& lig, const docking_options& o);
+
+	//! Runs the Monte Carlo tasks [gid0, gid1) of o.num_tasks of an encoded ligand in parallel, seeded from rng, publishing to board if not null, and waits for them to complete. The first num_warm tasks start from the ROOT poses of warm in turn.
+	void run_tasks(const receptor& rec, const ligand& lig, const int* const ligh, float* const slnd, vector<search_statistics>& stats, const size_t gid0, const size_t gid1, const docking_options& o, mt19937_64& rng, busy_accumulator& task_busy, progress_board* const board = nullptr, const vector<array<float, 7>>& warm = vector<array<float, 7>>(), const size_t num_warm = 0);
+
+	//! Encodes a ligand, runs its Monte Carlo tasks, all at once or in rounds with early stopping in latency mode, and clusters their conformations.
+	docking_result search(const receptor& rec, const ligand& lig, const docking_options& o, const function<void(const docking_result&)>& improved, busy_accumulator& task_busy);
+
+	io_service_pool io;
+	scoring_function sf;
+	forest f;
+	map<string, unique_ptr<receptor>> receptors; //!< Receptors keyed by file path, search space and granularity.
+	map_manager maps; //!< Manager of the memory budget of dense grid maps.
+	safe_counter<size_t> cnt;
+	safe_function safe_print;
+	busy_accumulator busy;
+};
+
+#endif
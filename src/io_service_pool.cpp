@@ -1,12 +1,24 @@
+#ifdef __linux__
+#include <pthread.h>
+#endif
 #include "io_service_pool.hpp"
 
-io_service_pool::io_service_pool(const size_t num_threads) : w(new work(*this))
+io_service_pool::io_service_pool(const size_t num_threads, const bool pin) : w(new work(*this))
 {
 	reserve(num_threads);
 	for (size_t i = 0; i < num_threads; ++i)
 	{
-		emplace_back(async(launch::async, [&]()
+		emplace_back(async(launch::async, [&, i, pin]()
 		{
+#ifdef __linux__
+			if (pin)
+			{
+				cpu_set_t cpus;
+				CPU_ZERO(&cpus);
+				CPU_SET(i % max<unsigned>(thread::hardware_concurrency(), 1), &cpus);
+				pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+			}
+#endif
 			run();
 		}));
 	}
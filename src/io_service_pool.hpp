@@ -11,8 +11,8 @@ using namespace boost::asio;
 class io_service_pool : public io_service, public vector<future<void>>
 {
 public:
-	//! Creates a number of threads to listen to the post event of an io service.
-	explicit io_service_pool(const size_t num_threads);
+	//! Creates a number of threads to listen to the post event of an io service. If pin is true, thread i is pinned to core i modulo the number of cores on Linux.
+	explicit io_service_pool(const size_t num_threads, const bool pin = false);
 
 	//! Waits for all the posted work and created threads to complete, and propagates thrown exceptions if any.
 	void wait();
@@ -1,9 +1,12 @@
 #include <cmath>
 #include <cassert>
+#include <limits>
 #include <random>
 #include "kernel.hpp"
+#include "progress_board.hpp"
+#include "brick_maps.hpp"
 
-bool evaluate(float* e, float* g, float* a, float* q, float* c, float* d, float* f, float* t, const float* x, const int nf, const int na, const int np, const float eub, const int* shared, const float* sfe, const float* sfd, const int sfs, const array<float, 3> cr0, const array<float, 3> cr1, const array<int, 3> npr, const float gri, const vector<vector<float>>& mps, const int gid, const int gds)
+bool evaluate(float* e, float* g, float* a, float* q, float* c, float* d, float* f, float* t, const float* x, const int nf, const int na, const int np, const float eub, const int* shared, const float* sfe, const float* sfd, const int sfs, const array<float, 3> cr0, const array<float, 3> cr1, const array<int, 3> npr, const float gri, const vector<vector<float>>& mps, const brick_maps* const bms, const int gid, const int gds, search_statistics& st)
 {
 	const int gd3 = 3 * gds;
 	const int gd4 = 4 * gds;
@@ -31,6 +34,7 @@ bool evaluate(float* e, float* g, float* a, float* q, float* c, float* d, float*
 	float y, y0, y1, y2, v0, v1, v2, c0, c1, c2, e000, e100, e010, e001, a0, a1, a2, ang, sng, r0, r1, r2, r3, vs, dr, f0, f1, f2, t0, t1, t2, d0, d1, d2;
 	float q0, q1, q2, q3, q00, q01, q02, q03, q11, q12, q13, q22, q23, q33, m0, m1, m2, m3, m4, m5, m6, m7, m8;
 	int i, j, k, b, w, i0, i1, i2, k0, k1, k2, z;
+	size_t o;
 	const float* map;
 
 	// Apply position, orientation and torsions.
@@ -112,6 +116,7 @@ bool evaluate(float* e, float* g, float* a, float* q, float* c, float* d, float*
 			// Penalize out-of-box case.
 			if (c0 < cr0[0] || cr1[0] <= c0 || c1 < cr0[1] || cr1[1] <= c1 || c2 < cr0[2] || cr1[2] <= c2)
 			{
+				IDOCK_COUNT(st.out_of_box_penalties);
 				y += 10.0f;
 				d[i0] = 0.0f;
 				d[i1] = 0.0f;
@@ -126,14 +131,25 @@ bool evaluate(float* e, float* g, float* a, float* q, float* c, float* d, float*
 			assert(k0 + 1 < npr[0]);
 			assert(k1 + 1 < npr[1]);
 			assert(k2 + 1 < npr[2]);
-			k0 = npr[0] * (npr[1] * k2 + k1) + k0;
-
-			// Retrieve the grid map and lookup the value
-			 map = mps[xst[i]].data();
-			e000 = map[k0];
-			e100 = map[k0 + 1];
-			e010 = map[k0 + npr[0]];
-			e001 = map[k0 + npr[0] * npr[1]];
+
+			// Retrieve the grid map and lookup the value, with 64-bit offsets.
+			if (bms)
+			{
+				map = bms->lookup(xst[i], k0, k1, k2, o);
+				e000 = map[o];
+				e100 = map[o + 1];
+				e010 = map[o + brick_maps::stride1];
+				e001 = map[o + brick_maps::stride2];
+			}
+			else
+			{
+				o = npr[0] * (npr[1] * static_cast<size_t>(k2) + k1) + k0;
+				map = mps[xst[i]].data();
+				e000 = map[o];
+				e100 = map[o + 1];
+				e010 = map[o + npr[0]];
+				e001 = map[o + static_cast<size_t>(npr[0]) * npr[1]];
+			}
 			y += e000;
 			d[i0] = (e100 - e000) * gri;
 			d[i1] = (e010 - e000) * gri;
@@ -310,8 +326,10 @@ bool evaluate(float* e, float* g, float* a, float* q, float* c, float* d, float*
 	return true;
 }
 
-void monte_carlo(float* const s0e, const int* const lig, const int nv, const int nf, const int na, const int np, const int seed, const int nbi, const float* const sfe, const float* const sfd, const int sfs, const array<float, 3> cr0, const array<float, 3> cr1, const array<int, 3> npr, const float gri, const vector<vector<float>>& mps, const int gid, const int gds)
+void monte_carlo(float* const s0e, const int* const lig, const int nv, const int nf, const int na, const int np, const int seed, const int nbi, const float* const sfe, const float* const sfd, const int sfs, const array<float, 3> cr0, const array<float, 3> cr1, const array<int, 3> npr, const float gri, const vector<vector<float>>& mps, const brick_maps* const bms, const int ncg, const array<int, 3> cnpr, const float cgri, const vector<vector<float>>& cmps, const int gid, const int gds, search_statistics& stats, progress_board* const board, const float* const warm)
 {
+	// Count events in a local copy, so that tasks of neighbouring gids on other threads do not contend for the cache lines of their stats entries in the hot loops.
+	search_statistics st;
 	const int nls = 5; // Number of line search trials for determining step size in BFGS
 	const float eub = 40.0f * na; // A conformation will be droped if its free energy is not better than e_upper_bound.
 	float* const s0x = &s0e[gds];
@@ -348,9 +366,16 @@ void monte_carlo(float* const s0e, const int* const lig, const int nv, const int
 	float sum, pg1, pga, pgc, alp, pg2, pr0, pr1, pr2, nrm, ang, sng, pq0, pq1, pq2, pq3, s1xq0, s1xq1, s1xq2, s1xq3, s2xq0, s2xq1, s2xq2, s2xq3, bpi;
 	float yhy, yps, ryp, pco, bpj, bmj, ppj;
 	int g, i, j, o0, o1, o2;
+	float pbe = numeric_limits<float>::max();
 	mt19937_64 rng(seed);
 	uniform_real_distribution<double> uniform_01(0, 1);
 
+	// Search on the coarse grid maps first if requested.
+	array<int, 3> snpr = ncg ? cnpr : npr;
+	float sgri = ncg ? cgri : gri;
+	const vector<vector<float>>* smps = ncg ? &cmps : &mps;
+	const brick_maps* sbms = ncg ? nullptr : bms;
+
 	// Randomize s0x.
 	rd0 = uniform_01(rng);
 	s0x[o0  = gid] = rd0 * cr1[0] + (1 - rd0) * cr0[0];
@@ -371,11 +396,33 @@ void monte_carlo(float* const s0e, const int* const lig, const int nv, const int
 	{
 		s0x[o0 += gds] = uniform_01(rng);
 	}
-	evaluate(s0e, s0g, s0a, s0q, s0c, s0d, s0f, s0t, s0x, nf, na, np, eub, lig, sfe, sfd, sfs, cr0, cr1, npr, gri, mps, gid, gds);
+
+	// Overwrite the random ROOT position and orientation with the warm ones if given. The random numbers are drawn regardless to keep the sequence of the task.
+	if (warm)
+	{
+		for (i = 0, o0 = gid; i < 7; ++i, o0 += gds)
+		{
+			s0x[o0] = warm[i];
+		}
+	}
+	IDOCK_COUNT(st.evaluations);
+	if (!evaluate(s0e, s0g, s0a, s0q, s0c, s0d, s0f, s0t, s0x, nf, na, np, eub, lig, sfe, sfd, sfs, cr0, cr1, snpr, sgri, *smps, sbms, gid, gds, st)) IDOCK_COUNT(st.eub_rejections);
 
 	// Repeat for a number of generations.
 	for (g = 0; g < nbi; ++g)
 	{
+		// Switch to the fine grid maps for refinement, and reevaluate x0 on them, as free energies on maps of different granularities are not comparable.
+		if (g == ncg && ncg)
+		{
+			snpr = npr;
+			sgri = gri;
+			smps = &mps;
+			sbms = bms;
+			pbe = numeric_limits<float>::max();
+			IDOCK_COUNT(st.evaluations);
+			evaluate(s0e, s0g, s0a, s0q, s0c, s0d, s0f, s0t, s0x, nf, na, np, numeric_limits<float>::max(), lig, sfe, sfd, sfs, cr0, cr1, snpr, sgri, *smps, sbms, gid, gds, st);
+		}
+
 		// Mutate s0x into s1x
 		o0  = gid;
 		s1x[o0] = s0x[o0] + uniform_01(rng);
@@ -389,7 +436,9 @@ void monte_carlo(float* const s0e, const int* const lig, const int nv, const int
 			o0 += gds;
 			s1x[o0] = s0x[o0];
 		}
-		evaluate(s1e, s1g, s1a, s1q, s1c, s1d, s1f, s1t, s1x, nf, na, np, eub, lig, sfe, sfd, sfs, cr0, cr1, npr, gri, mps, gid, gds);
+		IDOCK_COUNT(st.generations);
+		IDOCK_COUNT(st.evaluations);
+		if (!evaluate(s1e, s1g, s1a, s1q, s1c, s1d, s1f, s1t, s1x, nf, na, np, eub, lig, sfe, sfd, sfs, cr0, cr1, snpr, sgri, *smps, sbms, gid, gds, st)) IDOCK_COUNT(st.eub_rejections);
 
 		// Initialize the inverse Hessian matrix to identity matrix.
 		// An easier option that works fine in practice is to use a scalar multiple of the identity matrix,
@@ -491,7 +540,8 @@ void monte_carlo(float* const s0e, const int* const lig, const int nv, const int
 				// Evaluate x2, subject to Wolfe conditions http://en.wikipedia.org/wiki/Wolfe_conditions
 				// 1) Armijo rule ensures that the step length alpha decreases f sufficiently.
 				// 2) The curvature condition ensures that the slope has been reduced sufficiently.
-				if (evaluate(s2e, s2g, s2a, s2q, s2c, s2d, s2f, s2t, s2x, nf, na, np, s1e[gid] + alp * pga, lig, sfe, sfd, sfs, cr0, cr1, npr, gri, mps, gid, gds))
+				IDOCK_COUNT(st.evaluations);
+				if (evaluate(s2e, s2g, s2a, s2q, s2c, s2d, s2f, s2t, s2x, nf, na, np, s1e[gid] + alp * pga, lig, sfe, sfd, sfs, cr0, cr1, snpr, sgri, *smps, sbms, gid, gds, st))
 				{
 					o0 = gid;
 					pg2 = bfp[o0] * s2g[o0];
@@ -507,7 +557,12 @@ void monte_carlo(float* const s0e, const int* const lig, const int nv, const int
 			}
 
 			// If no appropriate alpha can be found, exit the BFGS loop.
-			if (j == nls) break;
+			if (j == nls)
+			{
+				IDOCK_COUNT(st.line_search_failures);
+				break;
+			}
+			IDOCK_COUNT(st.bfgs_iterations);
 
 			// Calculate y = g2 - g1.
 			o0 = gid;
@@ -586,6 +641,7 @@ void monte_carlo(float* const s0e, const int* const lig, const int nv, const int
 		// Accept x1 according to Metropolis criteria.
 		if (s1e[gid] < s0e[gid])
 		{
+			IDOCK_COUNT(st.metropolis_acceptances);
 			o0 = gid;
 			s0e[o0] = s1e[o0];
 //			for (i = 1; i < nv + 2; ++i)
@@ -595,5 +651,13 @@ void monte_carlo(float* const s0e, const int* const lig, const int nv, const int
 				s0e[o0] = s1e[o0];
 			}
 		}
+
+		// Publish x0 every interval generations if it has improved since the last publication.
+		if (board && !((g + 1) % board->interval) && s0e[gid] < pbe)
+		{
+			pbe = s0e[gid];
+			board->publish(gid, pbe, s0x, gds);
+		}
 	}
+	stats = st;
 }
@@ -3,8 +3,52 @@
 #define IDOCK_KERNEL_HPP
 
 #include <array>
+#include <vector>
 using namespace std;
 
-void monte_carlo(float* const s0e, const int* const lig, const int nv, const int nf, const int na, const int np, const int seed, const int nbi, const float* const sfe, const float* const sfd, const int sfs, const array<float, 3> cr0, const array<float, 3> cr1, const array<int, 3> npr, const float gri, const vector<vector<float>>& mps, const int gid, const int gds);
+class progress_board;
+class brick_maps;
+
+//! Increments a search statistics counter, unless counting is compiled out by defining IDOCK_NO_STATISTICS.
+#ifdef IDOCK_NO_STATISTICS
+#define IDOCK_COUNT(counter) ((void)0)
+#else
+#define IDOCK_COUNT(counter) ++(counter)
+#endif
+
+//! Represents counters of the events of Monte Carlo tasks, collected per task and aggregated per ligand.
+class search_statistics
+{
+public:
+	size_t generations; //!< Number of Monte Carlo generations.
+	size_t evaluations; //!< Number of evaluate() calls.
+	size_t bfgs_iterations; //!< Number of accepted BFGS steps.
+	size_t line_search_failures; //!< Number of BFGS loops exited because no step size satisfied the Wolfe conditions.
+	size_t eub_rejections; //!< Number of initial or mutated conformations refused for exceeding the free energy upper bound.
+	size_t out_of_box_penalties; //!< Number of atoms penalized for lying outside the search space.
+	size_t metropolis_acceptances; //!< Number of generations whose locally optimized conformation was accepted.
+
+	//! Constructs zero counters.
+	explicit search_statistics() : generations(0), evaluations(0), bfgs_iterations(0), line_search_failures(0), eub_rejections(0), out_of_box_penalties(0), metropolis_acceptances(0) {}
+
+	//! Accumulates the counters of another task.
+	search_statistics& operator+=(const search_statistics& st)
+	{
+		generations += st.generations;
+		evaluations += st.evaluations;
+		bfgs_iterations += st.bfgs_iterations;
+		line_search_failures += st.line_search_failures;
+		eub_rejections += st.eub_rejections;
+		out_of_box_penalties += st.out_of_box_penalties;
+		metropolis_acceptances += st.metropolis_acceptances;
+		return *this;
+	}
+};
+
+//! Evaluates the free energy e and its gradient g of the conformation x of task gid, refusing the conformation and returning false if e is no better than eub. The grid maps are looked up in the sparse maps bms if not null, or in the dense maps mps otherwise.
+bool evaluate(float* e, float* g, float* a, float* q, float* c, float* d, float* f, float* t, const float* x, const int nf, const int na, const int np, const float eub, const int* shared, const float* sfe, const float* sfd, const int sfs, const array<float, 3> cr0, const array<float, 3> cr1, const array<int, 3> npr, const float gri, const vector<vector<float>>& mps, const brick_maps* const bms, const int gid, const int gds, search_statistics& st);
+
+//! Runs a Monte Carlo task, storing the counts of its events to stats once at the end, and publishing its best conformation to board every board->interval generations if board is not null. If warm is not null, the task starts from its 7 elements of ROOT position and orientation instead of random ones, with random torsions. The first ncg of the nbi generations, fewer than nbi, search on the dense coarse grid maps cmps of cnpr probes and inverse granularity cgri, and the rest refine on the fine ones, which are sparse if bms is not null.
+void monte_carlo(float* const s0e, const int* const lig, const int nv, const int nf, const int na, const int np, const int seed, const int nbi, const float* const sfe, const float* const sfd, const int sfs, const array<float, 3> cr0, const array<float, 3> cr1, const array<int, 3> npr, const float gri, const vector<vector<float>>& mps, const brick_maps* const bms, const int ncg, const array<int, 3> cnpr, const float cgri, const vector<vector<float>>& cmps, const int gid, const int gds, search_statistics& stats, progress_board* const board, const float* const warm);
 
 #endif
@@ -3,9 +3,9 @@
 #include "array.hpp"
 #include "ligand.hpp"
 
-void frame::output(boost::filesystem::ofstream& ofs) const
+void frame::output(ostream& os) const
 {
-	ofs << "BRANCH"    << setw(4) << rotorXsrn << setw(4) << rotorYsrn << '\n';
+	os << "BRANCH"    << setw(4) << rotorXsrn << setw(4) << rotorYsrn << '\n';
 }
 
 ligand::ligand(const path& p) : filename(p.filename()), xs{}, nv(6)
@@ -329,39 +329,39 @@ void ligand::encode(int* const p) const
 	assert(c == p + get_lig_elems());
 }
 
-//! Represents a solution found by BFGS local optimization for later clustering.
-class solution
+size_t ligand::hash() const
 {
-public:
-//	float e; //!< Free energy.
-//	vector<float> x; //!< Conformation vector.
-	vector<array<float, 4>> q; //!< Frame quaternions.
-	vector<array<float, 3>> c; //!< Heavy atom coordinates.
-};
-
-void ligand::write(const float* const ex, const path& output_folder_path, const size_t max_conformations, const size_t num_tasks, const receptor& rec, const forest& f, const scoring_function& sf)
+	vector<int> p(get_lig_elems());
+	encode(p.data());
+	size_t h = 14695981039346656037ULL;
+	const unsigned char* const b = reinterpret_cast<const unsigned char*>(p.data());
+	for (size_t i = 0; i < sizeof(int) * p.size(); ++i)
+	{
+		h = (h ^ b[i]) * 1099511628211ULL; // 64-bit FNV-1a
+	}
+	return h;
+}
+
+vector<solution> ligand::cluster(const float* const ex, const size_t max_conformations, const size_t num_tasks, const size_t num_completed, const receptor& rec, const rescoring& rs) const
 {
 	// Sort solutions in ascending order of e.
-	vector<size_t> rank(num_tasks);
+	vector<size_t> rank(num_completed);
 	iota(rank.begin(), rank.end(), 0);
 	sort(rank.begin(), rank.end(), [&ex](const size_t v0, const size_t v1)
 	{
 		return ex[v0] < ex[v1];
 	});
 
-	// Cluster solutions with RMSD of 2.0 and save them on the fly.
+	// Cluster solutions with RMSD of 2.0.
 	const float square_deviation_threshold = 4.0f * na;
 	vector<solution> solutions;
 	solutions.reserve(max_conformations);
-	affinities.reserve(max_conformations);
-	boost::filesystem::ofstream ofs(output_folder_path / filename);
-	ofs.setf(ios::fixed, ios::floatfield);
-	ofs << setprecision(3);
 	for (const size_t r : rank)
 	{
 		// Recover q and c from x.
 		solution s;
 		size_t o;
+		s.e = ex[r];
 		s.q.resize(nf);
 		s.c.resize(na);
 		s.c[0][0] = ex[o  = num_tasks + r];
@@ -409,46 +409,40 @@ void ligand::write(const float* const ex, const path& output_folder_path, const
 		}
 		if (!representative) continue;
 
-		// Rescore conformations with random forest.
-		array<float, tree::nv> x{};
-		for (size_t i = 0; i < na; ++i)
-		{
-			const atom& la = atoms[i];
-			for (const atom& ra : rec.atoms)
-			{
-				const float ds = distance_sqr(s.c[i], ra.coord);
-				if (ds >= 144) continue; // RF-Score cutoff 12A
-				if (!la.rf_unsupported() && !ra.rf_unsupported())
-				{
-					++x[(la.rf << 2) + ra.rf];
-				}
-				if (ds >= 64) continue; // Vina score cutoff 8A
-				if (!la.xs_unsupported() && !ra.xs_unsupported())
-				{
-					sf.score(x.data() + 36, la.xs, ra.xs, ds);
-				}
-			}
-		}
-		x.back() = 1 / (1 + 0.05846f * (nv - 6 + 0.5f * (nf - 1 - (nv - 6))));
-		affinities.push_back(ex[r]);
-//		affinities.push_back(f(x));
+		// Rescore the conformation for consensus ranking.
+		s.scores = rs(*this, s.c, rec);
 
+		// Check if the number of conformations to write has been reached the upper bound.
+		solutions.push_back(move(s));
+		if (solutions.size() == solutions.capacity()) break;
+	}
+	return solutions;
+}
+
+void ligand::write(ostream& os, const vector<solution>& solutions) const
+{
+	const auto flags = os.flags();
+	const auto precision = os.precision();
+	os.setf(ios::fixed, ios::floatfield);
+	os << setprecision(3);
+	for (const solution& s : solutions)
+	{
 		// Dump the ROOT frame.
-		ofs << "ROOT\n";
+		os << "ROOT\n";
 		{
 			const frame& f = frames.front();
 			const array<float, 9> m = qtn4_to_mat3(s.q[0]);
 			for (size_t i = f.rotorYidx; i < f.childYidx; ++i)
 			{
 				const atom& a = atoms[i];
-				a.output(ofs, s.c[i]);
+				a.output(os, s.c[i]);
 				for (const atom& h : a.hydrogens)
 				{
-					h.output(ofs, s.c[f.rotorYidx] + m * h.coord);
+					h.output(os, s.c[f.rotorYidx] + m * h.coord);
 				}
 			}
 		}
-		ofs << "ENDROOT\n";
+		os << "ENDROOT\n";
 
 		// Dump the BRANCH frames.
 		vector<bool> dumped(nf); // dump_branches[0] is dummy. The ROOT frame has been dumped.
@@ -467,21 +461,21 @@ void ligand::write(const float* const ex, const path& output_folder_path, const
 			const frame& f = frames[fn];
 			if (dumped[fn]) // This BRANCH frame has been dumped.
 			{
-				ofs << "END";
-				f.output(ofs);
+				os << "END";
+				f.output(os);
 				stack.pop_back();
 			}
 			else // This BRANCH frame has not been dumped.
 			{
-				f.output(ofs);
+				f.output(os);
 				const array<float, 9> m = qtn4_to_mat3(s.q[f.active ? fn : f.parent]);
 				for (size_t i = f.rotorYidx; i < f.childYidx; ++i)
 				{
 					const atom& a = atoms[i];
-					a.output(ofs, s.c[i]);
+					a.output(os, s.c[i]);
 					for (const atom& h : a.hydrogens)
 					{
-						h.output(ofs, s.c[f.rotorYidx] + m * h.coord);
+						h.output(os, s.c[f.rotorYidx] + m * h.coord);
 					}
 				}
 				dumped[fn] = true;
@@ -491,10 +485,22 @@ void ligand::write(const float* const ex, const path& output_folder_path, const
 				}
 			}
 		}
-		ofs << "TORSDOF " << nf - 1 << '\n';
+		os << "TORSDOF " << nf - 1 << '\n';
+	}
+	os.flags(flags);
+	os.precision(precision);
+}
 
-		// Check if the number of conformations to write has been reached the upper bound.
-		solutions.push_back(move(s));
-		if (solutions.size() == solutions.capacity()) break;
+void ligand::write(const float* const ex, const path& output_folder_path, const size_t max_conformations, const size_t num_tasks, const receptor& rec, const rescoring& rs)
+{
+	const vector<solution> solutions = cluster(ex, max_conformations, num_tasks, num_tasks, rec, rs);
+	affinities.reserve(solutions.size());
+	scores.reserve(solutions.size());
+	for (const solution& s : solutions)
+	{
+		affinities.push_back(s.e);
+		scores.push_back(s.scores);
 	}
+	boost::filesystem::ofstream ofs(output_folder_path / filename);
+	write(ofs, solutions);
 }
\ No newline at end of file
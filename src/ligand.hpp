@@ -7,6 +7,7 @@
 #include "random_forest.hpp"
 #include "atom.hpp"
 #include "receptor.hpp"
+#include "rescoring.hpp"
 using namespace boost::filesystem;
 
 //! Represents a ROOT or a BRANCH in PDBQT structure.
@@ -24,11 +25,21 @@ public:
 	array<float, 3> xy; //!< Normalized vector pointing from rotor X of parent frame to rotor Y of current frame.
 	vector<size_t> branches; //!< Indexes to child branches.
 
-	//! Constructs an active frame, and relates it to its parent frame.
-	explicit frame(const size_t parent, const size_t rotorXsrn, const size_t rotorYsrn, const size_t rotorXidx, const size_t rotorYidx) : parent(parent), rotorXsrn(rotorXsrn), rotorYsrn(rotorYsrn), rotorXidx(rotorXidx), rotorYidx(rotorYidx), active(true) {}
+	//! Constructs an active frame, and relates it to its parent frame. yy and xy are zeroed, as they are never set for the ROOT frame but are encoded.
+	explicit frame(const size_t parent, const size_t rotorXsrn, const size_t rotorYsrn, const size_t rotorXidx, const size_t rotorYidx) : parent(parent), rotorXsrn(rotorXsrn), rotorYsrn(rotorYsrn), rotorXidx(rotorXidx), rotorYidx(rotorYidx), active(true), yy(), xy() {}
 
 	//! Outputs a BRANCH line in PDBQT format.
-	void output(boost::filesystem::ofstream& ofs) const;
+	void output(ostream& os) const;
+};
+
+//! Represents a predicted conformation of a ligand.
+class solution
+{
+public:
+	float e; //!< Free energy.
+	vector<array<float, 4>> q; //!< Frame quaternions.
+	vector<array<float, 3>> c; //!< Heavy atom coordinates.
+	vector<float> scores; //!< Scores by the scorers of the rescoring stage.
 };
 
 //! Represents a ligand.
@@ -44,6 +55,7 @@ public:
 	size_t na; //!< Number of heavy atoms.
 	size_t np; //!< Number of non 1-4 interacting pairs.
 	vector<float> affinities; //!< Binding affinities of predicted conformations.
+	vector<vector<float>> scores; //!< Scores of predicted conformations by the scorers of the rescoring stage.
 
 	//! Constructs a ligand by parsing a ligand file in PDBQT format.
 	explicit ligand(const path& p);
@@ -51,8 +63,17 @@ public:
 	//! Encodes the current ligand into an array of integers.
 	void encode(int* const p) const;
 
-	//! Writes conformations in PDBQT format to file.
-	void write(const float* const ex, const path& output_folder_path, const size_t max_conformations, const size_t num_tasks, const receptor& rec, const forest& f, const scoring_function& sf);
+	//! Returns a 64-bit hash of the encoding, i.e. the atom types, frame topology and relative coordinates, which is equal for duplicate ligands of identical atom order.
+	size_t hash() const;
+
+	//! Sorts the conformations of the first num_completed of num_tasks Monte Carlo tasks by free energy, and returns at most max_conformations of them clustered with an RMSD of 2 Angstrom and scored by the scorers of rs.
+	vector<solution> cluster(const float* const ex, const size_t max_conformations, const size_t num_tasks, const size_t num_completed, const receptor& rec, const rescoring& rs) const;
+
+	//! Outputs conformations in PDBQT format.
+	void write(ostream& os, const vector<solution>& solutions) const;
+
+	//! Clusters conformations, saves their binding affinities and scores by the scorers of rs, and writes them in PDBQT format to file.
+	void write(const float* const ex, const path& output_folder_path, const size_t max_conformations, const size_t num_tasks, const receptor& rec, const rescoring& rs);
 
 	//! Gets the number of elements of the current ligand.
 	size_t get_lig_elems() const;
@@ -12,6 +12,13 @@ void log_engine::write(const path& log_path) const
 	{
 		log << ",pKd" << i;
 	}
+	for (const string& name : score_names)
+	{
+		for (size_t i = 1; i <= max_conformations; ++i)
+		{
+			log << ',' << name << i;
+		}
+	}
 	log << '\n' << setprecision(2);
 	for (const auto& r : *this)
 	{
@@ -24,6 +31,25 @@ void log_engine::write(const path& log_path) const
 		{
 			log << ',';
 		}
+		for (size_t k = 0; k < score_names.size(); ++k)
+		{
+			for (size_t i = 0; i < max_conformations; ++i)
+			{
+				log << ',';
+				if (i < r.scores.size() && k < r.scores[i].size()) log << r.scores[i][k];
+			}
+		}
 		log << '\n';
 	}
 }
+
+void log_engine::write_statistics(const path& statistics_path) const
+{
+	boost::filesystem::ofstream log(statistics_path);
+	log << "Ligand,Generations,Evaluations,BFGSIterations,LineSearchFailures,EubRejections,OutOfBoxPenalties,MetropolisAcceptances\n";
+	for (const auto& r : *this)
+	{
+		const search_statistics& st = r.statistics;
+		log << r.stem << ',' << st.generations << ',' << st.evaluations << ',' << st.bfgs_iterations << ',' << st.line_search_failures << ',' << st.eub_rejections << ',' << st.out_of_box_penalties << ',' << st.metropolis_acceptances << '\n';
+	}
+}
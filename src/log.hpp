@@ -4,6 +4,7 @@
 
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/filesystem/path.hpp>
+#include "kernel.hpp"
 using namespace std;
 using namespace boost::filesystem;
 
@@ -13,9 +14,11 @@ class log_record
 public:
 	const string stem; //!< Stem of the ligand filename.
 	const vector<float> affinities; //!< Predicted binding affinities of the ligand.
+	const search_statistics statistics; //!< Search statistics aggregated over the Monte Carlo tasks of the ligand.
+	const vector<vector<float>> scores; //!< Scores of the predicted conformations by the scorers of the rescoring stage.
 
-	//! Constructs a log record by moving the file stem and predicted binding affinities of a ligand.
-	explicit log_record(string&& stem_, vector<float>&& affinities_) : stem(move(stem_)), affinities(move(affinities_)) {}
+	//! Constructs a log record by moving the file stem, predicted binding affinities and rescoring scores of a ligand.
+	explicit log_record(string&& stem_, vector<float>&& affinities_, const search_statistics& statistics_ = search_statistics(), vector<vector<float>>&& scores_ = vector<vector<float>>()) : stem(move(stem_)), affinities(move(affinities_)), statistics(statistics_), scores(move(scores_)) {}
 };
 
 //! Compares two log records by their first predicted binding affinity.
@@ -28,8 +31,13 @@ inline bool operator<(const log_record& r0, const log_record& r1)
 class log_engine : public boost::ptr_vector<log_record>
 {
 public:
+	vector<string> score_names; //!< Names of the scorers of the rescoring stage, whose scores of every conformation follow the predicted binding affinities.
+
 	//! Write ligand log records to the log file.
 	void write(const path& log_path) const;
+
+	//! Write the search statistics of ligand log records to the statistics file.
+	void write_statistics(const path& statistics_path) const;
 };
 
 #endif
@@ -0,0 +1,260 @@
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <boost/filesystem/operations.hpp>
+#include "random_forest.hpp"
+#include "receptor.hpp"
+#include "ligand.hpp"
+#include "kernel.hpp"
+#include "profiler.hpp"
+
+//! Represents the timing samples of a benchmark, each of which times a number of calls.
+class benchmark
+{
+public:
+	//! Constructs an empty benchmark of a name, whose samples each time a number of calls.
+	explicit benchmark(string&& name, const size_t calls_per_sample) : name(move(name)), calls_per_sample(calls_per_sample) {}
+
+	//! Times f() as one sample.
+	template <typename F>
+	void operator()(F f)
+	{
+		const stopwatch sw;
+		f();
+		samples.push_back(sw.elapsed() / calls_per_sample);
+	}
+
+	//! Writes the name, number of samples, calls per sample, and min, median, mean and max seconds per call as a csv line.
+	void write(ostream& os)
+	{
+		sort(samples.begin(), samples.end());
+		const size_t n = samples.size();
+		const double median = n & 1 ? samples[n >> 1] : 0.5 * (samples[(n >> 1) - 1] + samples[n >> 1]);
+		double sum = 0;
+		for (const double s : samples) sum += s;
+		os << name << ',' << n << ',' << calls_per_sample << ',' << samples.front() << ',' << median << ',' << sum / n << ',' << samples.back() << endl;
+	}
+private:
+	const string name;
+	const size_t calls_per_sample;
+	vector<double> samples;
+};
+
+int main(int argc, char* argv[])
+{
+	path receptor_path, ligand_path, output_folder_path;
+	array<float, 3> center, size;
+	size_t seed, num_trees, num_bfgs_iterations, repeats, batch;
+	float granularity;
+
+	// Parse program options in a try/catch block.
+	try
+	{
+		// Initialize the default values of optional arguments, which are the fixtures of examples/2IQH.
+		const path default_receptor_path = "receptors/2IQH.pdbqt";
+		const path default_ligand_path = "ligands/ZINC/ZINC71639762.pdbqt";
+		const path default_output_folder_path = "benchmark_output";
+		const size_t default_seed = 1;
+		const size_t default_num_trees = 128;
+		const size_t default_num_bfgs_iterations = 300;
+		const size_t default_repeats = 16;
+		const size_t default_batch = 1000;
+		const  float default_granularity = 0.15625f;
+
+		using namespace boost::program_options;
+		options_description options("options (optional)");
+		options.add_options()
+			("receptor", value<path>(&receptor_path)->default_value(default_receptor_path), "receptor in PDBQT format")
+			("ligand", value<path>(&ligand_path)->default_value(default_ligand_path), "ligand in PDBQT format")
+			("output_folder", value<path>(&output_folder_path)->default_value(default_output_folder_path), "folder of output ligands in PDBQT format")
+			("center_x", value<float>(&center[0])->default_value(76), "x coordinate of the search space center")
+			("center_y", value<float>(&center[1])->default_value(102), "y coordinate of the search space center")
+			("center_z", value<float>(&center[2])->default_value(26), "z coordinate of the search space center")
+			("size_x", value<float>(&size[0])->default_value(23), "size in the x dimension in Angstrom")
+			("size_y", value<float>(&size[1])->default_value(24), "size in the y dimension in Angstrom")
+			("size_z", value<float>(&size[2])->default_value(21), "size in the z dimension in Angstrom")
+			("seed", value<size_t>(&seed)->default_value(default_seed), "explicit non-negative random seed")
+			("trees", value<size_t>(&num_trees)->default_value(default_num_trees), "trees in random forest")
+			("generations", value<size_t>(&num_bfgs_iterations)->default_value(default_num_bfgs_iterations), "generations in BFGS")
+			("granularity", value<float>(&granularity)->default_value(default_granularity), "density of probe atoms of grid maps")
+			("repeats", value<size_t>(&repeats)->default_value(default_repeats), "samples of each benchmark, and Monte Carlo tasks to write")
+			("batch", value<size_t>(&batch)->default_value(default_batch), "calls per sample of evaluate() and forest prediction")
+			("help", "help information")
+			;
+		variables_map vm;
+		store(parse_command_line(argc, argv, options), vm);
+		if (vm.count("help"))
+		{
+			cout << "idock_bm runs single-threaded microbenchmarks of the hot kernels and writes seconds per call in csv format" << endl << options;
+			return 0;
+		}
+		vm.notify();
+		if (!is_regular_file(receptor_path) || !is_regular_file(ligand_path))
+		{
+			cerr << "Receptor " << receptor_path << " or ligand " << ligand_path << " does not exist or is not a regular file" << endl;
+			return 1;
+		}
+		if (!repeats || !batch)
+		{
+			cerr << "The options '--repeats' and '--batch' must be positive" << endl;
+			return 1;
+		}
+		if (!exists(output_folder_path)) create_directories(output_folder_path);
+	}
+	catch (const exception& e)
+	{
+		cerr << e.what() << endl;
+		return 1;
+	}
+
+	cout.setf(ios::scientific, ios::floatfield);
+	cout << setprecision(6) << "Benchmark,Samples,CallsPerSample,Min,Median,Mean,Max" << endl;
+
+	// Precalculate the scoring function, one sample per atom type pair.
+	scoring_function sf;
+	benchmark precalculate("scoring_function::precalculate", 1);
+	for (size_t t1 = 0; t1 < sf.n; ++t1)
+	for (size_t t0 = 0; t0 <=  t1; ++t0)
+	{
+		precalculate([&]()
+		{
+			sf.precalculate(t0, t1);
+		});
+	}
+	precalculate.write(cout);
+	sf.clear();
+
+	// Parse the receptor repeatedly, keeping the last one.
+	benchmark parse_receptor("receptor::receptor", 1);
+	unique_ptr<receptor> rec_ptr;
+	for (size_t i = 0; i < repeats; ++i)
+	{
+		parse_receptor([&]()
+		{
+			rec_ptr.reset(new receptor(receptor_path, center, size, granularity));
+		});
+	}
+	parse_receptor.write(cout);
+	receptor& rec = *rec_ptr;
+
+	// Parse and encode the ligand repeatedly, keeping the last one.
+	benchmark parse_ligand("ligand::ligand+encode", 1);
+	vector<int> ligh;
+	unique_ptr<ligand> lig_ptr;
+	for (size_t i = 0; i < repeats; ++i)
+	{
+		parse_ligand([&]()
+		{
+			lig_ptr.reset(new ligand(ligand_path));
+			ligh.resize(lig_ptr->get_lig_elems());
+			lig_ptr->encode(ligh.data());
+		});
+	}
+	parse_ligand.write(cout);
+	ligand& lig = *lig_ptr;
+
+	// Populate the grid maps of the ligand atom types, one sample per slice.
+	vector<size_t> xs;
+	for (size_t t = 0; t < sf.n; ++t)
+	{
+		if (!lig.xs[t]) continue;
+		rec.maps[t].resize(rec.num_probes_product);
+		xs.push_back(t);
+	}
+	rec.precalculate(sf, xs);
+	benchmark populate("receptor::populate(" + to_string(xs.size()) + " types)", 1);
+	for (size_t z = 0; z < static_cast<size_t>(rec.num_probes[2]); ++z)
+	{
+		populate([&]()
+		{
+			rec.populate(xs, z, sf);
+		});
+	}
+	populate.write(cout);
+
+	// Train the random forest, one sample per tree, and predict repeatedly.
+	forest f(num_trees, seed);
+	benchmark train("tree::train", 1);
+	for (size_t i = 0; i < num_trees; ++i)
+	{
+		train([&]()
+		{
+			f[i].train(4, f.seed(i));
+		});
+	}
+	train.write(cout);
+	f.clear();
+	array<float, tree::nv> features;
+	mt19937_64 rng(seed);
+	uniform_real_distribution<float> uniform_features(0, 16);
+	for (auto& x : features) x = uniform_features(rng);
+	benchmark predict("forest::operator()", batch);
+	volatile float prediction;
+	for (size_t i = 0; i < repeats; ++i)
+	{
+		predict([&]()
+		{
+			for (size_t j = 0; j < batch; ++j)
+			{
+				prediction = f(features);
+			}
+		});
+	}
+	predict.write(cout);
+
+	// Run one Monte Carlo task per sample, laid out as repeats tasks for ligand::write.
+	const size_t num_tasks = repeats;
+	vector<float> slnd(lig.get_sln_elems() * num_tasks);
+	vector<search_statistics> stats(num_tasks);
+	benchmark mc("monte_carlo", 1);
+	for (size_t gid = 0; gid < num_tasks; ++gid)
+	{
+		const size_t s = rng();
+		mc([&]()
+		{
+			monte_carlo(slnd.data(), ligh.data(), lig.nv, lig.nf, lig.na, lig.np, s, num_bfgs_iterations, sf.e.data(), sf.d.data(), sf.ns, rec.corner0, rec.corner1, rec.num_probes, rec.granularity_inverse, rec.maps, nullptr, 0, rec.num_probes, rec.granularity_inverse, rec.maps, gid, num_tasks, stats[gid], nullptr, nullptr);
+		});
+	}
+	mc.write(cout);
+
+	// Evaluate the final conformation of task 0 repeatedly, with the same layout as monte_carlo().
+	const int gds = num_tasks, nv = lig.nv, nf = lig.nf, na = lig.na;
+	float* const s0e = slnd.data();
+	float* const s0x = &s0e[gds];
+	float* const s0g = &s0x[(nv + 1) * gds];
+	float* const s0a = &s0g[nv * gds];
+	float* const s0q = &s0a[3 * nf * gds];
+	float* const s0c = &s0q[4 * nf * gds];
+	float* const s0d = &s0c[3 * na * gds];
+	float* const s0f = &s0d[3 * na * gds];
+	float* const s0t = &s0f[3 * nf * gds];
+	const vector<float> e(s0e, s0e + lig.get_cnf_elems() * num_tasks);
+	benchmark eval("evaluate", batch);
+	for (size_t i = 0; i < repeats; ++i)
+	{
+		eval([&]()
+		{
+			for (size_t j = 0; j < batch; ++j)
+			{
+				evaluate(s0e, s0g, s0a, s0q, s0c, s0d, s0f, s0t, s0x, nf, na, lig.np, numeric_limits<float>::max(), ligh.data(), sf.e.data(), sf.d.data(), sf.ns, rec.corner0, rec.corner1, rec.num_probes, rec.granularity_inverse, rec.maps, nullptr, 0, gds, stats[0]);
+			}
+		});
+	}
+	eval.write(cout);
+
+	// Cluster, rescore by all the built-in scorers and write the conformations of the Monte Carlo tasks repeatedly.
+	const rescoring rs(vector<string>(rescoring::builtin.cbegin(), rescoring::builtin.cend()), f, sf);
+	benchmark write("ligand::write", 1);
+	for (size_t i = 0; i < repeats; ++i)
+	{
+		lig.affinities.clear();
+		lig.scores.clear();
+		write([&]()
+		{
+			lig.write(e.data(), output_folder_path, 9, num_tasks, rec, rs);
+		});
+	}
+	write.write(cout);
+}
@@ -335,7 +335,7 @@ int main(int argc, char* argv[])
 	{
 		io.post([&, i]()
 		{
-			f[i].train(4, f.u01_s);
+			f[i].train(4, f.seed(i));
 			cnt.increment();
 		});
 	}
@@ -503,7 +503,7 @@ int main(int argc, char* argv[])
 				auto& idle = cbd->idle;
 
 				// Write conformations.
-				lig.write(cnfh, output_folder_path, max_conformations, num_tasks, rec, f, sf);
+				lig.write(cnfh, output_folder_path, max_conformations, num_tasks, rec, rescoring());
 
 				// Unmap cnfh.
 				checkOclErrors(clEnqueueUnmapMemObject(queue, slnd, cnfh, 0, NULL, NULL));
@@ -2,22 +2,25 @@
 #include <iostream>
 #include <iomanip>
 #include <numeric>
+#include <algorithm>
 #include <boost/program_options.hpp>
 #include <boost/filesystem/operations.hpp>
-#include "io_service_pool.hpp"
-#include "safe_class.hpp"
-#include "random_forest.hpp"
-#include "receptor.hpp"
-#include "ligand.hpp"
-#include "log.hpp"
-#include "kernel.hpp"
+#include "box.hpp"
+#include "tracer.hpp"
+#include "docking_session.hpp"
+#include "server.hpp"
+#include "campaign.hpp"
 
 int main(int argc, char* argv[])
 {
-	path receptor_path, input_folder_path, output_folder_path, log_path;
+	path receptor_path, input_folder_path, output_folder_path, log_path, box_ligand_path, profile_json_path, trace_path, statistics_path, socket_path, cache_folder_path, map_folder_path, campaign_path;
 	array<float, 3> center, size;
-	size_t seed, num_threads, num_trees, num_tasks, num_bfgs_iterations, max_conformations;
-	float granularity;
+	size_t seed, num_threads, num_trees, num_tasks, num_bfgs_iterations, max_conformations, patience, report_interval, coarse_generations, map_budget;
+	float granularity, box_margin, warm_start, coarse_granularity;
+	vector<string> box_residues, rescorers;
+	size_t scaling_ligands = 0;
+	bool profile, pin, latency, report_poses, deduplicate, sparse;
+	unique_ptr<campaign> matrix;
 
 	// Parse program options in a try/catch block.
 	try
@@ -25,31 +28,47 @@ int main(int argc, char* argv[])
 		// Initialize the default values of optional arguments.
 		const path default_output_folder_path = "output";
 		const path default_log_path = "log.csv";
-		const size_t default_seed = chrono::system_clock::now().time_since_epoch().count();
+		const size_t default_seed = std::chrono::system_clock::now().time_since_epoch().count();
 		const size_t default_num_threads = thread::hardware_concurrency();
 		const size_t default_num_trees = 128;
 		const size_t default_num_tasks = 256;
 		const size_t default_num_bfgs_iterations = 300;
 		const size_t default_max_conformations = 9;
+		const size_t default_patience = 32;
 		const  float default_granularity = 0.15625f;
+		const  float default_coarse_granularity = 0.625f;
+		const  float default_box_margin = 5;
 
 		// Set up options description.
 		using namespace boost::program_options;
 		options_description input_options("input (required)");
 		input_options.add_options()
-			("receptor", value<path>(&receptor_path)->required(), "receptor in PDBQT format")
-			("input_folder", value<path>(&input_folder_path)->required(), "folder of input ligands in PDBQT format")
-			("center_x", value<float>(&center[0])->required(), "x coordinate of the search space center")
-			("center_y", value<float>(&center[1])->required(), "y coordinate of the search space center")
-			("center_z", value<float>(&center[2])->required(), "z coordinate of the search space center")
-			("size_x", value<float>(&size[0])->required(), "size in the x dimension in Angstrom")
-			("size_y", value<float>(&size[1])->required(), "size in the y dimension in Angstrom")
-			("size_z", value<float>(&size[2])->required(), "size in the z dimension in Angstrom")
+			("receptor", value<path>(&receptor_path), "receptor in PDBQT format")
+			("input_folder", value<path>(&input_folder_path), "folder of input ligands in PDBQT format")
+			("center_x", value<float>(&center[0]), "x coordinate of the search space center")
+			("center_y", value<float>(&center[1]), "y coordinate of the search space center")
+			("center_z", value<float>(&center[2]), "z coordinate of the search space center")
+			("size_x", value<float>(&size[0]), "size in the x dimension in Angstrom")
+			("size_y", value<float>(&size[1]), "size in the y dimension in Angstrom")
+			("size_z", value<float>(&size[2]), "size in the z dimension in Angstrom")
+			;
+		options_description box_options("search space fitting (optional, in place of center and size)");
+		box_options.add_options()
+			("box_ligand", value<path>(&box_ligand_path), "reference ligand in PDBQT format to fit the search space to")
+			("box_residue", value<vector<string>>(&box_residues)->multitoken(), "pocket residues of the receptor to fit the search space to, e.g. A:123 A:145")
+			("box_margin", value<float>(&box_margin)->default_value(default_box_margin), "margin in Angstrom added to every side of the fitted search space")
 			;
 		options_description output_options("output (optional)");
 		output_options.add_options()
 			("output_folder", value<path>(&output_folder_path)->default_value(default_output_folder_path), "folder of output ligands in PDBQT format")
 			("log", value<path>(&log_path)->default_value(default_log_path), "log file in csv format")
+			("statistics", value<path>(&statistics_path), "log file of per-ligand search statistics in csv format")
+			("cache", value<path>(&cache_folder_path), "folder of a result cache shared across runs, from which ligands docked before with the same receptor, search space and parameters are written without docking")
+			("profile", bool_switch(&profile), "print per-stage timings, throughput and thread utilization")
+			("profile_json", value<path>(&profile_json_path), "file to write per-stage and per-ligand timings to in JSON format")
+			("trace", value<path>(&trace_path), "file to write task and lock events of worker threads to in Chrome trace JSON format")
+			("report", value<size_t>(&report_interval)->default_value(0), "print the provisional top conformations of a ligand while it is docked, publishing the best conformation of every task every this many generations, or never if 0")
+			("report_poses", bool_switch(&report_poses), "also write the provisional conformations to the output file")
 			;
 		options_description miscellaneous_options("options (optional)");
 		miscellaneous_options.add_options()
@@ -60,12 +79,26 @@ int main(int argc, char* argv[])
 			("generations", value<size_t>(&num_bfgs_iterations)->default_value(default_num_bfgs_iterations), "generations in BFGS")
 			("max_conformations", value<size_t>(&max_conformations)->default_value(default_max_conformations), "maximum binding conformations to write")
 			("granularity", value<float>(&granularity)->default_value(default_granularity), "density of probe atoms of grid maps")
+			("coarse_generations", value<size_t>(&coarse_generations)->default_value(0), "early generations of every Monte Carlo task to search on coarse grid maps before refining on the fine ones, fewer than generations, or none if 0")
+			("coarse_granularity", value<float>(&coarse_granularity)->default_value(default_coarse_granularity), "density of probe atoms of coarse grid maps")
+			("map_budget", value<size_t>(&map_budget)->default_value(0), "memory budget in MB of the dense grid maps of all receptors and search spaces, evicting the least recently used maps to make room, or unlimited if 0")
+			("map_cache", value<path>(&map_folder_path), "folder to spill grid maps evicted under the memory budget to and reload them from")
+			("sparse", bool_switch(&sparse), "use sparse grid maps of bricks computed as the Monte Carlo tasks touch them, for search spaces too large for dense grid maps such as a whole protein")
+			("rescore", value<vector<string>>(&rescorers)->multitoken(), "built-in scorers to rescore the written conformations by for consensus ranking, i.e. rf, vina and contacts, whose scores follow the predicted affinities in the log")
+			("pin", bool_switch(&pin), "pin worker threads to cores")
+			("warm_start", value<float>(&warm_start)->default_value(0), "fraction of the Monte Carlo tasks of a ligand to start from the best ROOT poses of the last docked ligand of the same ROOT atom types and geometry, keeping random torsions")
+			("deduplicate", bool_switch(&deduplicate), "dock only the first of duplicate ligands of identical atom types, frame topology and relative coordinates, and write its conformations for the others")
+			("latency", bool_switch(&latency), "dock one ligand at a time with all worker threads, rewriting its output file whenever its top conformation improves")
+			("patience", value<size_t>(&patience)->default_value(default_patience), "in latency mode, stop early once the top 3 conformations have not changed over this many tasks, or never if 0")
+			("campaign", value<path>(&campaign_path), "job matrix of targets and libraries in csv format to dock every library against every target of, in place of the input options, i.e. lines of target,name,receptor,center_x,center_y,center_z,size_x,size_y,size_z and of library,name,folder")
+			("daemon", value<path>(&socket_path), "serve docking jobs on this Unix domain socket, keeping the scoring function, random forest and grid maps warm across jobs, in place of the input options")
+			("benchmark_scaling", value<size_t>(&scaling_ligands), "dock a sample of this many ligands at 1, 2, 4, ... threads, unpinned and also pinned if --pin is given, and report speedup, parallel efficiency and idle time per stage")
 			("help", "help information")
 			("version", "version information")
 			("config", value<path>(), "configuration file to load options from")
 			;
 		options_description all_options;
-		all_options.add(input_options).add(output_options).add(miscellaneous_options);
+		all_options.add(input_options).add(box_options).add(output_options).add(miscellaneous_options);
 
 		// Parse command line arguments.
 		variables_map vm;
@@ -94,38 +127,126 @@ int main(int argc, char* argv[])
 
 		// Notify the user of parsing errors, if any.
 		vm.notify();
-
-		// Validate receptor.
-		if (!is_regular_file(receptor_path))
+		if (vm.count("cache") && vm["seed"].defaulted())
 		{
-			cerr << "Receptor " << receptor_path << " does not exist or is not a regular file" << endl;
+			cerr << "The option '--cache' requires an explicit '--seed', as cached results are keyed by the seed" << endl;
 			return 1;
 		}
-
-		// Validate input_folder.
-		if (!is_directory(input_folder_path))
+		if (warm_start < 0 || warm_start > 1)
 		{
-			cerr << "Input folder " << input_folder_path << " does not exist or is not a directory" << endl;
+			cerr << "The option '--warm_start' must be between 0 and 1" << endl;
 			return 1;
 		}
-
-		// Validate output_folder.
-		if (exists(output_folder_path))
+		if ((coarse_generations && coarse_generations >= num_bfgs_iterations) || coarse_granularity <= 0)
 		{
-			if (!is_directory(output_folder_path))
+			cerr << "The option '--coarse_generations' must be fewer than '--generations', and '--coarse_granularity' must be positive" << endl;
+			return 1;
+		}
+		for (const string& r : rescorers)
+		{
+			if (find(rescoring::builtin.cbegin(), rescoring::builtin.cend(), r) == rescoring::builtin.cend())
 			{
-				cerr << "Output folder " << output_folder_path << " is not a directory" << endl;
+				cerr << "Unknown scorer " << r << " of the option '--rescore'" << endl;
 				return 1;
 			}
 		}
-		else
+
+		// In daemon mode, the receptor, search space, input and output are given per job. In campaign mode, the receptors, search spaces and inputs are given by the job matrix.
+		if (vm.count("campaign"))
+		{
+			// Reject the options that apply to a batch of ligands against one receptor, and those of latency mode and provisional reports, as a campaign docks every ligand in memory at once.
+			for (const string o : { "cache", "deduplicate", "warm_start", "statistics", "latency", "patience", "report", "report_poses" })
+			{
+				if (vm.count(o) && !vm[o].defaulted())
+				{
+					cerr << "The option '--" << o << "' does not apply to '--campaign'" << endl;
+					return 1;
+				}
+			}
+			matrix.reset(new campaign(campaign_path));
+		}
+		else if (!vm.count("daemon"))
 		{
-			if (!create_directories(output_folder_path))
+			// Check the options required for docking.
+			for (const string o : { "receptor", "input_folder" })
+			{
+				if (!vm.count(o))
+				{
+					cerr << "The option '--" << o << "' is required but missing" << endl;
+					return 1;
+				}
+			}
+
+			// Validate receptor.
+			if (!is_regular_file(receptor_path))
+			{
+				cerr << "Receptor " << receptor_path << " does not exist or is not a regular file" << endl;
+				return 1;
+			}
+
+			// Fit the search space to a reference ligand or pocket residues, or validate the explicitly given search space.
+			if (vm.count("box_ligand") && vm.count("box_residue"))
+			{
+				cerr << "The options '--box_ligand' and '--box_residue' are mutually exclusive" << endl;
+				return 1;
+			}
+			if (vm.count("box_ligand") || vm.count("box_residue"))
+			{
+				const path& p = vm.count("box_ligand") ? box_ligand_path : receptor_path;
+				if (!is_regular_file(p))
+				{
+					cerr << (vm.count("box_ligand") ? "Reference ligand " : "Receptor ") << p << " does not exist or is not a regular file" << endl;
+					return 1;
+				}
+				boost::filesystem::ifstream ifs(p);
+				const box b(ifs, vm.count("box_ligand") ? vector<string>() : box_residues, box_margin);
+				if (!b.num_atoms)
+				{
+					cerr << "No heavy atoms to fit the search space to in " << p << endl;
+					return 1;
+				}
+				center = b.center;
+				size = b.size;
+			}
+			else
 			{
-				cerr << "Failed to create output folder " << output_folder_path << endl;
+				for (const string o : { "center_x", "center_y", "center_z", "size_x", "size_y", "size_z" })
+				{
+					if (!vm.count(o))
+					{
+						cerr << "The option '--" << o << "' is required but missing" << endl;
+						return 1;
+					}
+				}
+			}
+
+			// Validate input_folder.
+			if (!is_directory(input_folder_path))
+			{
+				cerr << "Input folder " << input_folder_path << " does not exist or is not a directory" << endl;
 				return 1;
 			}
 		}
+		if (!vm.count("daemon"))
+		{
+			// Validate output_folder.
+			if (exists(output_folder_path))
+			{
+				if (!is_directory(output_folder_path))
+				{
+					cerr << "Output folder " << output_folder_path << " is not a directory" << endl;
+					return 1;
+				}
+			}
+			else
+			{
+				if (!create_directories(output_folder_path))
+				{
+					cerr << "Failed to create output folder " << output_folder_path << endl;
+					return 1;
+				}
+			}
+		}
 	}
 	catch (const exception& e)
 	{
@@ -133,156 +254,166 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 
-	// Initialize a Mersenne Twister random number generator.
-	cout << "Using random seed " << seed << endl;
-	mt19937_64 rng(seed);
-
-	cout << "Creating an io service pool of " << num_threads << " worker threads" << endl;
-	io_service_pool io(num_threads);
-	safe_counter<size_t> cnt;
-	safe_function safe_print;
+	// Enable event tracing before creating worker threads, keeping the most recent 1M events per thread.
+	if (!trace_path.empty()) tracer::enable(1 << 20);
 
-	cout << "Precalculating a scoring function of " << scoring_function::n << " atom types in parallel" << endl;
-	scoring_function sf;
-	cnt.init((sf.n + 1) * sf.n >> 1);
-	for (size_t t1 = 0; t1 < sf.n; ++t1)
-	for (size_t t0 = 0; t0 <=  t1; ++t0)
+	// Serve docking jobs on a warm docking session if requested.
+	if (!socket_path.empty())
 	{
-		io.post([&, t0, t1]()
+		cout << "Using random seed " << seed << endl;
+		profiler prof(num_threads);
+		int status;
 		{
-			sf.precalculate(t0, t1);
-			cnt.increment();
-		});
-	}
-	cnt.wait();
-	sf.clear();
-
-	cout << "Parsing receptor " << receptor_path << endl;
-	receptor rec(receptor_path, center, size, granularity);
-
-	vector<int>   ligh(2601);
-	vector<float> slnd(3438 * num_tasks);
-
-	cout << "Training a random forest of " << num_trees << " trees in parallel" << endl;
-	forest f(num_trees, seed);
-	cnt.init(num_trees);
-	for (size_t i = 0; i < num_trees; ++i)
-	{
-		io.post([&, i]()
+			docking_session session(num_threads, pin, num_trees, seed, cout, prof, map_budget << 20, map_folder_path);
+			server s(session, { output_folder_path, num_tasks, num_bfgs_iterations, max_conformations, seed, latency, patience, report_interval, report_poses, cache_folder_path, deduplicate, warm_start, coarse_generations, coarse_granularity, sparse, rescorers }, granularity);
+			status = s.run(socket_path);
+		}
+		if (tracer::enabled())
 		{
-			f[i].train(4, f.u01_s);
-			cnt.increment();
-		});
+			cout << "Writing trace to " << trace_path << endl;
+			tracer::write(trace_path);
+		}
+		return status;
 	}
-	cnt.wait();
-	f.clear();
 
-	// Perform docking for each ligand in the input folder.
-	log_engine log;
-	cout.setf(ios::fixed, ios::floatfield);
-	cout << "Executing " << num_tasks << " optimization runs of " << num_bfgs_iterations << " BFGS iterations in parallel" << endl
-	     << "   Index        Ligand    pKd 1     2     3     4     5     6     7     8     9" << endl << setprecision(2);
-	for (directory_iterator dir_iter(input_folder_path), const_dir_iter; dir_iter != const_dir_iter; ++dir_iter)
+	// Dock every library of the job matrix against every target if requested.
+	if (matrix)
 	{
-		// Filter files with .pdbqt extension name.
-		const path& input_ligand_path = dir_iter->path();
-		if (input_ligand_path.extension() != ".pdbqt") continue;
-
-		// Parse the ligand. Don't declare it const as it will be moved to the callback data wrapper.
-		ligand lig(input_ligand_path);
-
-		// Find atom types that are presented in the current ligand but not presented in the grid maps.
-		vector<size_t> xs;
-		for (size_t t = 0; t < sf.n; ++t)
+		cout << "Using random seed " << seed << endl;
+		profiler prof(num_threads);
 		{
-			if (lig.xs[t] && rec.maps[t].empty())
-			{
-				rec.maps[t].resize(rec.num_probes_product);
-				xs.push_back(t);
-			}
+			docking_session session(num_threads, pin, num_trees, seed, cout, prof, map_budget << 20, map_folder_path);
+			matrix->run(session, { output_folder_path, num_tasks, num_bfgs_iterations, max_conformations, seed, latency, patience, report_interval, report_poses, cache_folder_path, deduplicate, warm_start, coarse_generations, coarse_granularity, sparse, rescorers }, granularity, map_budget << 20, cout, prof);
 		}
-
-		// Create grid maps on the fly if necessary.
-		if (xs.size())
+		if (profile) prof.print(cout);
+		if (!profile_json_path.empty())
 		{
-			// Precalculate p_offset.
-			rec.precalculate(sf, xs);
-
-			// Create grid maps in parallel.
-			cnt.init(rec.num_probes[2]);
-			for (size_t z = 0; z < rec.num_probes[2]; ++z)
-			{
-				io.post([&,z]()
-				{
-					rec.populate(xs, z, sf);
-					cnt.increment();
-				});
-			}
-			cnt.wait();
+			cout << "Writing profile to " << profile_json_path << endl;
+			prof.write(profile_json_path);
 		}
-
-		// Reallocate ligh and ligd should the current ligand elements exceed the default size.
-		const size_t this_lig_elems = lig.get_lig_elems();
-		if (this_lig_elems > ligh.size())
+		if (tracer::enabled())
 		{
-			ligh.resize(this_lig_elems);
+			cout << "Writing trace to " << trace_path << endl;
+			tracer::write(trace_path);
 		}
+		return 0;
+	}
 
-		// Encode the current ligand.
-		lig.encode(ligh.data());
-
-		// Reallocate slnd should the current solution elements exceed the default size.
-		const size_t this_sln_elems = lig.get_sln_elems() * num_tasks;
-		if (this_sln_elems > slnd.size())
+	// Benchmark thread scaling on a fixed sample of ligands if requested.
+	if (scaling_ligands)
+	{
+		// Sample the first ligands in path order, so that every run docks the same ligands.
+		vector<path> sample;
+		for (directory_iterator dir_iter(input_folder_path), const_dir_iter; dir_iter != const_dir_iter; ++dir_iter)
 		{
-			slnd.resize(this_sln_elems);
+			if (dir_iter->path().extension() == ".pdbqt") sample.push_back(dir_iter->path());
+		}
+		sort(sample.begin(), sample.end());
+		if (sample.size() > scaling_ligands) sample.resize(scaling_ligands);
+		if (sample.empty())
+		{
+			cerr << "No ligands to benchmark in " << input_folder_path << endl;
+			return 1;
 		}
 
-		// Clear the solution buffer.
-		slnd.assign(slnd.size(), 0);
-
-		// Launch kernel.
-		cnt.init(num_tasks);
-		for (int gid = 0; gid < num_tasks; ++gid)
+		// Double the number of threads up to the given number of threads.
+		vector<size_t> thread_counts;
+		for (size_t n = 1; n < num_threads; n <<= 1)
+		{
+			thread_counts.push_back(n);
+		}
+		thread_counts.push_back(max<size_t>(num_threads, 1));
+
+		const array<string, 4> stage_names = {{ "Precalculating scoring function", "Training random forest", "Creating grid maps", "Docking ligands" }};
+		ostream null_os(nullptr);
+		cout.setf(ios::fixed, ios::floatfield);
+		cout << "Benchmarking thread scaling of docking " << sample.size() << " ligands" << endl
+		     << "Pinned,Threads,Stage,Wall,Busy,Speedup,Efficiency,Idle" << endl;
+		for (const bool pinned : pin ? vector<bool>{ false, true } : vector<bool>{ false })
 		{
-			const size_t s = rng();
-			io.post([&, s, gid]()
+			vector<stage_record> baseline;
+			for (const size_t n : thread_counts)
 			{
-				monte_carlo(slnd.data(), ligh.data(), lig.nv, lig.nf, lig.na, lig.np, s, num_bfgs_iterations, sf.e.data(), sf.d.data(), sf.ns, rec.corner0, rec.corner1, rec.num_probes, rec.granularity_inverse, rec.maps, gid, num_tasks);
-				cnt.increment();
-			});
+				log_engine log;
+				profiler prof(n);
+				{
+					docking_session session(n, pinned, num_trees, seed, null_os, prof, map_budget << 20, map_folder_path);
+					receptor& rec = session.get_receptor(receptor_path, center, size, granularity, null_os, prof);
+					size_t i = 0;
+
+					// Dock without the result cache, deduplication and warm starts, so that every run does the same docking work.
+					session.dock(rec, [&](path& p)
+					{
+						if (i == sample.size()) return false;
+						p = sample[i++];
+						return true;
+					}, { output_folder_path, num_tasks, num_bfgs_iterations, max_conformations, seed, latency, patience, report_interval, report_poses, path(), false, 0, coarse_generations, coarse_granularity, sparse, rescorers }, null_os, log, prof);
+				}
+				const double wall = prof.wall();
+				vector<stage_record> records;
+				for (const string& name : stage_names)
+				{
+					records.push_back(prof.sum(name));
+				}
+				const stage_record all = prof.sum("");
+				records.emplace_back("Overall", wall, all.busy, all.tasks);
+				if (baseline.empty()) baseline = records;
+				for (size_t k = 0; k < records.size(); ++k)
+				{
+					const stage_record& s = records[k];
+					const double speedup = s.wall > 0 ? baseline[k].wall / s.wall : 0;
+					cout << pinned << ',' << n << ',' << s.name << ',' << setprecision(3) << s.wall << ',' << s.busy << ',' << setprecision(2) << speedup << ',' << speedup / n << ',' << setprecision(1) << (s.wall > 0 ? 100 * (1 - s.busy / (s.wall * n)) : 0) << '%' << endl;
+				}
+			}
 		}
-		cnt.wait();
-
-		// Reallocate cnfh should the current conformation elements exceed the default size.
-		const size_t this_cnf_elems = lig.get_cnf_elems() * num_tasks;
+		return 0;
+	}
 
-		io.post(bind([&](ligand lig, vector<float> cnfh)
+	// Dock every ligand with .pdbqt extension name in the input folder.
+	cout << "Using random seed " << seed << endl;
+	log_engine log;
+	profiler prof(num_threads);
+	{
+		docking_session session(num_threads, pin, num_trees, seed, cout, prof, map_budget << 20, map_folder_path);
+		receptor& rec = session.get_receptor(receptor_path, center, size, granularity, cout, prof);
+		directory_iterator dir_iter(input_folder_path);
+		const directory_iterator const_dir_iter;
+		session.dock(rec, [&](path& p)
 		{
-			// Write conformations.
-			lig.write(cnfh.data(), output_folder_path, max_conformations, num_tasks, rec, f, sf);
-
-			// Output and save ligand stem and predicted affinities.
-			safe_print([&]()
+			for (; dir_iter != const_dir_iter; ++dir_iter)
 			{
-				string stem = lig.filename.stem().string();
-				cout << setw(8) << log.size() + 1 << setw(14) << stem << setw(2) << "   ";
-				for_each(lig.affinities.cbegin(), lig.affinities.cbegin() + min<size_t>(lig.affinities.size(), 9), [](const float a)
-				{
-					cout << setw(6) << a;
-				});
-				cout << endl;
-				log.push_back(new log_record(move(stem), move(lig.affinities)));
-			});
-		}, move(lig), vector<float>(slnd.cbegin(), slnd.cbegin() + this_cnf_elems)));
+				if (dir_iter->path().extension() != ".pdbqt") continue;
+				p = dir_iter->path();
+				++dir_iter;
+				return true;
+			}
+			return false;
+		}, { output_folder_path, num_tasks, num_bfgs_iterations, max_conformations, seed, latency, patience, report_interval, report_poses, cache_folder_path, deduplicate, warm_start, coarse_generations, coarse_granularity, sparse, rescorers }, cout, log, prof);
 	}
 
-	// Wait until the io service pool has finished all its tasks.
-	io.wait();
+	// Report the profile if requested.
+	if (profile) prof.print(cout);
+	if (!profile_json_path.empty())
+	{
+		cout << "Writing profile to " << profile_json_path << endl;
+		prof.write(profile_json_path);
+	}
+
+	// Flush the traced events now that all worker threads have finished.
+	if (tracer::enabled())
+	{
+		cout << "Writing trace to " << trace_path << endl;
+		tracer::write(trace_path);
+	}
 
 	// Sort and write ligand log records to the log file.
 	if (log.empty()) return 0;
 	cout << "Writing log records of " << log.size() << " ligands to " << log_path << endl;
 	log.sort();
 	log.write(log_path);
+	if (!statistics_path.empty())
+	{
+		cout << "Writing search statistics of " << log.size() << " ligands to " << statistics_path << endl;
+		log.write_statistics(statistics_path);
+	}
 }
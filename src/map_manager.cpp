@@ -0,0 +1,113 @@
+#include <iomanip>
+#include <sstream>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include "result_cache.hpp"
+#include "map_manager.hpp"
+
+map_manager::map_manager(const size_t budget, const path& folder) : budget(budget), folder(folder), num_evictions(0), num_reloads(0), total(0), epoch(0)
+{
+	if (budget && !folder.empty()) create_directories(folder);
+}
+
+void map_manager::begin()
+{
+	++epoch;
+}
+
+vector<size_t> map_manager::acquire(receptor& rec, const vector<size_t>& xs)
+{
+	// Mark the present maps as most recently used, and collect the missing ones.
+	vector<size_t> missing;
+	for (const size_t t : xs)
+	{
+		if (!budget)
+		{
+			if (rec.maps[t].empty()) missing.push_back(t);
+			continue;
+		}
+		const auto it = index.find(make_pair(&rec, t));
+		if (it == index.cend())
+		{
+			missing.push_back(t);
+			continue;
+		}
+		lru.splice(lru.begin(), lru, it->second);
+		it->second->epoch = epoch;
+	}
+	if (!budget || missing.empty()) return missing;
+
+	// Evict the least recently used maps of previous ligands until the missing maps fit.
+	const size_t needed = rec.map_bytes * missing.size();
+	while (total + needed > budget && !lru.empty() && lru.back().epoch != epoch)
+	{
+		const entry& e = lru.back();
+		vector<float>& m = e.rec->maps[e.t];
+		if (!folder.empty())
+		{
+			const path p = spill_path(*e.rec, e.t);
+			if (!exists(p))
+			{
+				const path tmp = folder / unique_path(p.filename().string() + ".%%%%%%%%.tmp");
+				{
+					boost::filesystem::ofstream ofs(tmp, ios::binary);
+					ofs.write(reinterpret_cast<const char*>(m.data()), e.rec->map_bytes);
+				}
+				rename(tmp, p);
+			}
+		}
+		vector<float>().swap(m);
+		total -= e.rec->map_bytes;
+		index.erase(make_pair(e.rec, e.t));
+		lru.pop_back();
+		++num_evictions;
+	}
+
+	// Track the missing maps, reloading those spilled before.
+	vector<size_t> created;
+	for (const size_t t : missing)
+	{
+		lru.push_front({ &rec, t, epoch });
+		index[make_pair(&rec, t)] = lru.begin();
+		total += rec.map_bytes;
+		if (!folder.empty())
+		{
+			const path p = spill_path(rec, t);
+			boost::filesystem::ifstream ifs(p, ios::binary);
+			if (ifs)
+			{
+				rec.maps[t].resize(rec.num_probes_product);
+				if (ifs.read(reinterpret_cast<char*>(rec.maps[t].data()), rec.map_bytes))
+				{
+					++num_reloads;
+					continue;
+				}
+				vector<float>().swap(rec.maps[t]);
+			}
+		}
+		created.push_back(t);
+	}
+	return created;
+}
+
+void map_manager::release(const receptor& rec)
+{
+	for (auto it = lru.begin(); it != lru.end();)
+	{
+		if (it->rec != &rec)
+		{
+			++it;
+			continue;
+		}
+		total -= rec.map_bytes;
+		index.erase(make_pair(it->rec, it->t));
+		it = lru.erase(it);
+	}
+}
+
+path map_manager::spill_path(const receptor& rec, const size_t t) const
+{
+	ostringstream oss;
+	oss << hex << setw(16) << setfill('0') << result_cache::hash(rec) << '_' << dec << t << ".map";
+	return folder / oss.str();
+}
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef IDOCK_MAP_MANAGER_HPP
+#define IDOCK_MAP_MANAGER_HPP
+
+#include <map>
+#include <list>
+#include "receptor.hpp"
+
+//! Represents a manager of the dense grid maps of the receptors of a docking session that keeps their total memory within a budget. It tracks the map of every atom type of every receptor, i.e. receptor file, search space and granularity, in least recently used order. To make room for the maps of a ligand, it evicts the least recently used maps not needed by the ligand, spilling them to a folder if given. An evicted map is reloaded from the folder, or otherwise created again, when a later ligand needs it. Without a budget, nothing is tracked.
+class map_manager
+{
+public:
+	//! Constructs a manager of a budget in bytes, or 0 for unlimited, spilling evicted maps to a folder unless it is empty.
+	explicit map_manager(const size_t budget, const path& folder);
+
+	//! Starts acquiring the maps of a new ligand. Maps acquired since are not evicted until the next call.
+	void begin();
+
+	//! Marks the maps of atom types xs of rec as most recently used, evicting maps not acquired since begin() to fit the missing ones in the budget, and reloads those spilled before. Returns the atom types whose maps are still missing and must be created.
+	vector<size_t> acquire(receptor& rec, const vector<size_t>& xs);
+
+	//! Stops tracking the maps of rec, which must be called before a tracked receptor is destroyed.
+	void release(const receptor& rec);
+
+	//! Returns the number of bytes of the tracked maps.
+	size_t bytes() const
+	{
+		return total;
+	}
+
+	const size_t budget; //!< Memory budget in bytes, or 0 for unlimited.
+	const path folder; //!< Folder of spilled maps, or empty.
+	size_t num_evictions; //!< Number of maps evicted.
+	size_t num_reloads; //!< Number of maps reloaded from the folder.
+private:
+	//! Represents a tracked map.
+	class entry
+	{
+	public:
+		receptor* rec; //!< Receptor of the map.
+		size_t t; //!< XScore atom type of the map.
+		size_t epoch; //!< Epoch of the last acquisition.
+	};
+
+	//! Returns the path of the spilled map of atom type t of rec, named after a hash of its atoms, search space and granularity.
+	path spill_path(const receptor& rec, const size_t t) const;
+
+	list<entry> lru; //!< Tracked maps from the most to the least recently used.
+	map<pair<const receptor*, size_t>, list<entry>::iterator> index; //!< Tracked maps keyed by receptor and atom type.
+	size_t total; //!< Number of bytes of the tracked maps.
+	size_t epoch; //!< Epoch of the current ligand.
+};
+
+#endif
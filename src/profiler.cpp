@@ -0,0 +1,116 @@
+#include <iomanip>
+#include <sstream>
+#include <boost/filesystem/fstream.hpp>
+#include "profiler.hpp"
+
+string json_string(const string& s)
+{
+	ostringstream oss;
+	oss << '"';
+	for (const char c : s)
+	{
+		switch (c)
+		{
+		case '"':  oss << "\\\""; break;
+		case '\\': oss << "\\\\"; break;
+		case '\n': oss << "\\n"; break;
+		case '\r': oss << "\\r"; break;
+		case '\t': oss << "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) oss << "\\u" << hex << setw(4) << setfill('0') << static_cast<int>(c) << dec << setfill(' ');
+			else oss << c;
+		}
+	}
+	oss << '"';
+	return oss.str();
+}
+
+profiler::profiler(const size_t num_threads) : num_threads(num_threads)
+{
+}
+
+void profiler::add_stage(string&& name, const double wall, const double busy, const size_t tasks)
+{
+	lock_guard<mutex> guard(m);
+	stages.emplace_back(move(name), wall, busy, tasks);
+}
+
+double profiler::wall() const
+{
+	return overall.elapsed();
+}
+
+stage_record profiler::sum(const string& prefix) const
+{
+	lock_guard<mutex> guard(m);
+	stage_record r(string(prefix), 0, 0, 0);
+	for (const auto& s : stages)
+	{
+		if (s.name.compare(0, prefix.size(), prefix)) continue;
+		r.wall += s.wall;
+		r.busy += s.busy;
+		r.tasks += s.tasks;
+	}
+	return r;
+}
+
+void profiler::add_ligand(ligand_record&& r)
+{
+	lock_guard<mutex> guard(m);
+	ligands.push_back(move(r));
+}
+
+void profiler::print(ostream& os) const
+{
+	lock_guard<mutex> guard(m);
+	const double wall = overall.elapsed();
+	double busy = 0, parse = 0, dock = 0, write = 0;
+	size_t evaluations = 0;
+	for (const auto& s : stages) busy += s.busy;
+	for (const auto& l : ligands)
+	{
+		parse += l.parse;
+		dock += l.dock;
+		write += l.write;
+		evaluations += l.evaluations;
+	}
+	const size_t n = ligands.size();
+	const auto flags = os.flags();
+	const auto precision = os.precision();
+	os.setf(ios::fixed, ios::floatfield);
+	os << "Profile of " << n << " ligands on " << num_threads << " worker threads" << endl
+	   << "                                         Stage    Wall(s)    Busy(s)    Tasks" << endl << setprecision(3);
+	for (const auto& s : stages)
+	{
+		os << setw(46) << s.name << setw(11) << s.wall << setw(11) << s.busy << setw(9) << s.tasks << endl;
+	}
+	os << "                                         Phase     Sum(s)     Avg(s)" << endl;
+	os << setw(46) << "Parsing and encoding ligands" << setw(11) << parse << setw(11) << (n ? parse / n : 0) << endl
+	   << setw(46) << "Monte Carlo tasks" << setw(11) << dock << setw(11) << (n ? dock / n : 0) << endl
+	   << setw(46) << "Clustering, rescoring and writing" << setw(11) << write << setw(11) << (n ? write / n : 0) << endl;
+	os << "Overall wall-clock time: " << wall << " s" << endl
+	   << "Throughput: " << setprecision(2) << n / wall << " ligands/s, " << setprecision(0) << (dock > 0 ? evaluations / dock : 0) << " evaluate() calls/s during Monte Carlo tasks" << endl
+	   << "Thread utilization: " << setprecision(1) << 100 * busy / (wall * num_threads) << "%" << endl;
+	os.flags(flags);
+	os.precision(precision);
+}
+
+void profiler::write(const path& json_path) const
+{
+	lock_guard<mutex> guard(m);
+	boost::filesystem::ofstream ofs(json_path);
+	ofs.setf(ios::fixed, ios::floatfield);
+	ofs << setprecision(6) << "{\n\"threads\": " << num_threads << ",\n\"wall\": " << overall.elapsed() << ",\n\"stages\": [";
+	for (size_t i = 0; i < stages.size(); ++i)
+	{
+		const auto& s = stages[i];
+		ofs << (i ? ",\n" : "\n") << "{\"name\": " << json_string(s.name) << ", \"wall\": " << s.wall << ", \"busy\": " << s.busy << ", \"tasks\": " << s.tasks << '}';
+	}
+	ofs << "\n],\n\"ligands\": [";
+	for (size_t i = 0; i < ligands.size(); ++i)
+	{
+		const auto& l = ligands[i];
+		ofs << (i ? ",\n" : "\n") << "{\"ligand\": " << json_string(l.stem) << ", \"parse\": " << l.parse << ", \"dock\": " << l.dock << ", \"write\": " << l.write << ", \"evaluations\": " << l.evaluations << '}';
+	}
+	ofs << "\n]\n}\n";
+}
@@ -0,0 +1,111 @@
+#pragma once
+#ifndef IDOCK_PROFILER_HPP
+#define IDOCK_PROFILER_HPP
+
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <boost/filesystem/path.hpp>
+using namespace std;
+using namespace boost::filesystem;
+
+//! Returns s as a quoted JSON string, escaping quotes, backslashes and control characters.
+string json_string(const string& s);
+
+//! Represents a stopwatch measuring wall-clock time since construction.
+class stopwatch
+{
+public:
+	//! Starts the stopwatch.
+	explicit stopwatch() : t0(std::chrono::steady_clock::now()) {}
+
+	//! Returns the elapsed time in seconds.
+	double elapsed() const
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	}
+private:
+	std::chrono::steady_clock::time_point t0;
+};
+
+//! Represents an accumulator of the execution time of tasks posted to the io service pool.
+class busy_accumulator
+{
+public:
+	//! Constructs an empty accumulator.
+	explicit busy_accumulator() : ns(0) {}
+
+	//! Adds the elapsed time of a stopwatch started at the beginning of a task. Thread safe.
+	void add(const stopwatch& sw)
+	{
+		ns += static_cast<long long>(sw.elapsed() * 1e9);
+	}
+
+	//! Returns the accumulated time in seconds, and resets the accumulator.
+	double reset()
+	{
+		return ns.exchange(0) * 1e-9;
+	}
+private:
+	atomic<long long> ns; //!< Accumulated time in nanoseconds.
+};
+
+//! Represents the timing of a pipeline stage, e.g. scoring function precalculation or a batch of grid maps.
+class stage_record
+{
+public:
+	string name; //!< Stage name.
+	double wall; //!< Wall-clock time of the stage in seconds.
+	double busy; //!< Sum of the execution time of the tasks posted to the io service pool in seconds.
+	size_t tasks; //!< Number of tasks posted to the io service pool.
+
+	explicit stage_record(string&& name, const double wall, const double busy, const size_t tasks) : name(move(name)), wall(wall), busy(busy), tasks(tasks) {}
+};
+
+//! Represents the timing of docking a ligand.
+class ligand_record
+{
+public:
+	string stem; //!< Stem of the ligand filename.
+	double parse; //!< Time spent parsing and encoding the ligand in seconds.
+	double dock; //!< Wall-clock time of the Monte Carlo tasks of the ligand in seconds.
+	double write; //!< Time spent clustering, rescoring and writing conformations in seconds.
+	size_t evaluations; //!< Number of evaluate() calls of the Monte Carlo tasks of the ligand.
+};
+
+//! Represents a wall-clock profiler of the docking pipeline, reporting per-stage and per-ligand timings and overall throughput.
+class profiler
+{
+public:
+	//! Constructs a profiler for an io service pool of a number of threads, and starts its overall stopwatch.
+	explicit profiler(const size_t num_threads);
+
+	//! Records the timing of a stage.
+	void add_stage(string&& name, const double wall, const double busy, const size_t tasks);
+
+	//! Returns the overall wall-clock time in seconds since construction.
+	double wall() const;
+
+	//! Returns the sums of the wall-clock time, busy time and tasks of the stages whose names begin with prefix, e.g. all the batches of grid maps.
+	stage_record sum(const string& prefix) const;
+
+	//! Records the timing of docking a ligand. Thread safe.
+	void add_ligand(ligand_record&& r);
+
+	//! Writes a human readable report of stage timings and throughput.
+	void print(ostream& os) const;
+
+	//! Writes the report in JSON format.
+	void write(const path& json_path) const;
+private:
+	const size_t num_threads; //!< Number of worker threads of the io service pool.
+	const stopwatch overall; //!< Stopwatch started at construction.
+	vector<stage_record> stages; //!< Stage timings in order of execution.
+	vector<ligand_record> ligands; //!< Ligand timings in order of completion.
+	mutable mutex m;
+};
+
+#endif
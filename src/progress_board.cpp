@@ -0,0 +1,91 @@
+#include "progress_board.hpp"
+
+progress_board::progress_board(const size_t num_tasks, const size_t nv, const size_t interval) : interval(interval), nx(nv + 1), sequences(num_tasks), es(num_tasks), xs(num_tasks * nx), publications(0)
+{
+	for (auto& s : sequences) s.store(0, memory_order_relaxed);
+}
+
+void progress_board::publish(const int gid, const float e, const float* const x, const int gds)
+{
+	atomic<size_t>& s = sequences[gid];
+	const size_t q = s.load(memory_order_relaxed);
+	s.store(q + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	es[gid].store(e, memory_order_relaxed);
+	for (size_t i = 0, o = gid; i < nx; ++i, o += gds)
+	{
+		xs[gid * nx + i].store(x[o], memory_order_relaxed);
+	}
+	s.store(q + 2, memory_order_release);
+	publications.fetch_add(1, memory_order_release);
+}
+
+size_t progress_board::snapshot(vector<float>& ex) const
+{
+	// Read every published slot, retrying while it is being written.
+	vector<float> e, x(nx), px;
+	for (size_t gid = 0; gid < sequences.size(); ++gid)
+	{
+		const atomic<size_t>& s = sequences[gid];
+		size_t q0, q1;
+		float ei;
+		do
+		{
+			q0 = s.load(memory_order_acquire);
+			ei = es[gid].load(memory_order_relaxed);
+			for (size_t i = 0; i < nx; ++i)
+			{
+				x[i] = xs[gid * nx + i].load(memory_order_relaxed);
+			}
+			atomic_thread_fence(memory_order_acquire);
+			q1 = s.load(memory_order_relaxed);
+		} while (q0 & 1 || q0 != q1);
+		if (!q0) continue;
+		e.push_back(ei);
+		px.insert(px.end(), x.cbegin(), x.cend());
+	}
+
+	// Lay out the free energies followed by the conformation vectors element by element.
+	const size_t n = e.size();
+	ex.resize((nx + 1) * n);
+	for (size_t k = 0; k < n; ++k)
+	{
+		ex[k] = e[k];
+		for (size_t i = 0; i < nx; ++i)
+		{
+			ex[n * (i + 1) + k] = px[k * nx + i];
+		}
+	}
+	return n;
+}
+
+progress_reporter::progress_reporter(const progress_board& board, const std::chrono::milliseconds period, function<void()>&& report) : stop(false)
+{
+	t = thread([&board, period, report, this]()
+	{
+		size_t reported = 0;
+		unique_lock<mutex> lock(m);
+		while (!cv.wait_for(lock, period, [this]()
+		{
+			return stop;
+		}))
+		{
+			const size_t v = board.version();
+			if (v == reported) continue;
+			reported = v;
+			lock.unlock();
+			report();
+			lock.lock();
+		}
+	});
+}
+
+progress_reporter::~progress_reporter()
+{
+	{
+		lock_guard<mutex> guard(m);
+		stop = true;
+	}
+	cv.notify_one();
+	t.join();
+}
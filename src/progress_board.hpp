@@ -0,0 +1,58 @@
+#pragma once
+#ifndef IDOCK_PROGRESS_BOARD_HPP
+#define IDOCK_PROGRESS_BOARD_HPP
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+using namespace std;
+
+//! Represents a lock-free board to which the Monte Carlo tasks of a ligand publish their best conformations every interval generations, and from which provisional results are read while the tasks run. Each task owns a slot guarded by a sequence lock, so publishing never blocks and reading retries on a torn slot.
+class progress_board
+{
+public:
+	//! Constructs an empty board of num_tasks slots, each holding a free energy and a conformation vector of nv + 1 elements.
+	explicit progress_board(const size_t num_tasks, const size_t nv, const size_t interval);
+
+	//! Publishes the free energy e and the conformation vector x, laid out with a stride of gds as in monte_carlo(), of task gid. Must only be called by task gid.
+	void publish(const int gid, const float e, const float* const x, const int gds);
+
+	//! Copies the published slots into ex in the layout of ligand::cluster() with a stride of the returned number of published tasks.
+	size_t snapshot(vector<float>& ex) const;
+
+	//! Returns the number of publications so far, which changes whenever the board does.
+	size_t version() const
+	{
+		return publications.load(memory_order_acquire);
+	}
+
+	const size_t interval; //!< Number of generations between publications.
+private:
+	const size_t nx; //!< Number of elements of a conformation vector.
+	vector<atomic<size_t>> sequences; //!< Per-slot sequence numbers, odd while a slot is being written and 0 if never published.
+	vector<atomic<float>> es; //!< Per-slot free energies.
+	vector<atomic<float>> xs; //!< Per-slot conformation vectors.
+	atomic<size_t> publications;
+};
+
+//! Represents a thread that calls report() whenever a progress board has changed, at most once per period, until destructed.
+class progress_reporter
+{
+public:
+	//! Starts the reporter thread.
+	explicit progress_reporter(const progress_board& board, const std::chrono::milliseconds period, function<void()>&& report);
+
+	//! Stops and joins the reporter thread.
+	~progress_reporter();
+private:
+	mutex m;
+	condition_variable cv;
+	bool stop;
+	thread t;
+};
+
+#endif
@@ -6,31 +6,67 @@ node::node() : children{}
 {
 }
 
-void tree::train(const size_t mtry, const function<double()> u01)
+tree::ranking::ranking()
 {
+	array<size_t, ns> order;
+	for (size_t v = 0; v < nv; ++v)
+	{
+		iota(order.begin(), order.end(), 0);
+		sort(order.begin(), order.end(), [v](const size_t s0, const size_t s1)
+		{
+			return x[s0][v] < x[s1][v];
+		});
+		for (const size_t s : order)
+		{
+			if (values[v].empty() || values[v].back() != x[s][v]) values[v].push_back(x[s][v]);
+			ranks[v][s] = static_cast<uint16_t>(values[v].size() - 1);
+		}
+	}
+}
+
+const tree::ranking& tree::presorted()
+{
+	static const ranking r;
+	return r;
+}
+
+void tree::train(const size_t mtry, const size_t seed)
+{
+	const ranking& r = presorted();
+	mt19937_64 rng(seed);
+	uniform_real_distribution<double> u01(0, 1); // double is required because float could possibly generate 1.
+
 	// Create bootstrap samples with replacement.
-	reserve((ns << 1) - 1);
-	emplace_back();
-	node& root = front();
-	root.samples.resize(ns);
-	for (size_t& s : root.samples)
+	samples.resize(ns);
+	for (size_t& s : samples)
 	{
-		s = static_cast<size_t>(u01() * ns);
+		s = static_cast<size_t>(u01(rng) * ns);
 	}
+	reserve((ns << 1) - 1);
+	emplace_back();
+	front().begin = 0;
+	front().end = ns;
+
+	// Allocate the histogram of y sums and populations over the ranks of a variable, and the buffer of ranks and y values to sort, once per tree.
+	vector<float> bin_sum(ns);
+	vector<size_t> bin_pop(ns);
+	vector<pair<uint16_t, float>> keys;
+	keys.reserve(ns);
 
 	// Populate nodes.
 	for (size_t k = 0; k < size(); ++k)
 	{
 		node& n = (*this)[k];
+		const size_t num_samples = n.end - n.begin;
 
 		// Evaluate node y and purity.
 		float sum = 0;
-		for (const size_t s : n.samples) sum += y[s];
-		n.y = sum / n.samples.size();
-		n.p = sum * n.y; // = n.y * n.y * n.samples.size() = sum * sum / n.samples.size().
+		for (size_t i = n.begin; i < n.end; ++i) sum += y[samples[i]];
+		n.y = sum / num_samples;
+		n.p = sum * n.y; // = n.y * n.y * num_samples = sum * sum / num_samples.
 
 		// Do not split the node if it contains too few samples.
-		if (n.samples.size() <= 5) continue;
+		if (num_samples <= 5) continue;
 
 		// Find the best split that has the highest increase in node purity.
 		float bestChildNodePurity = n.p;
@@ -39,37 +75,64 @@ void tree::train(const size_t mtry, const function<double()> u01)
 		for (size_t i = 0; i < mtry; ++i)
 		{
 			// Randomly select a variable without replacement.
-			const size_t j = static_cast<size_t>(u01() * (nv - i));
+			const size_t j = static_cast<size_t>(u01(rng) * (nv - i));
 			const size_t v = mind[j];
 			mind[j] = mind[nv - i - 1];
+			const array<uint16_t, ns>& ranks = r.ranks[v];
+			const vector<float>& values = r.values[v];
 
-			// Sort the samples in ascending order of the selected variable.
-			vector<size_t> ncase(n.samples.size());
-			iota(ncase.begin(), ncase.end(), 0);
-			sort(ncase.begin(), ncase.end(), [&n, v](const size_t val1, const size_t val2)
-			{
-				return x[n.samples[val1]][v] < x[n.samples[val2]][v];
-			});
-
-			// Search through the gaps in the selected variable.
+			// Search through the gaps between the distinct values of the selected variable, which are in ascending order of rank.
 			float suml = 0;
-			float sumr = sum;
 			size_t popl = 0;
-			size_t popr = n.samples.size();
-			for (size_t j = 0; j < n.samples.size() - 1; ++j)
+			const auto gap = [&](const size_t r0, const size_t r1)
 			{
-				const float d = y[n.samples[ncase[j]]];
-				suml += d;
-				sumr -= d;
-				++popl;
-				--popr;
-				if (x[n.samples[ncase[j]]][v] == x[n.samples[ncase[j+1]]][v]) continue;
+				const float sumr = sum - suml;
+				const size_t popr = num_samples - popl;
 				const float curChildNodePurity = (suml * suml / popl) + (sumr * sumr / popr);
 				if (curChildNodePurity > bestChildNodePurity)
 				{
 					bestChildNodePurity = curChildNodePurity;
 					n.var = v;
-					n.val = (x[n.samples[ncase[j]]][v] + x[n.samples[ncase[j+1]]][v]) * 0.5f;
+					n.val = (values[r0] + values[r1]) * 0.5f;
+				}
+			};
+			if (values.size() < num_samples << 3)
+			{
+				// Accumulate a histogram over the ranks when there are few distinct values relative to the node samples.
+				for (size_t i = n.begin; i < n.end; ++i)
+				{
+					const size_t s = samples[i];
+					bin_sum[ranks[s]] += y[s];
+					++bin_pop[ranks[s]];
+				}
+				size_t last = 0;
+				for (size_t b = 0; b < values.size(); ++b)
+				{
+					if (!bin_pop[b]) continue;
+					if (popl) gap(last, b);
+					suml += bin_sum[b];
+					popl += bin_pop[b];
+					bin_sum[b] = 0;
+					bin_pop[b] = 0;
+					last = b;
+				}
+			}
+			else
+			{
+				// Otherwise sort the node samples by their integer ranks.
+				keys.clear();
+				for (size_t i = n.begin; i < n.end; ++i)
+				{
+					const size_t s = samples[i];
+					keys.emplace_back(ranks[s], y[s]);
+				}
+				sort(keys.begin(), keys.end());
+				for (size_t j = 0; j < num_samples - 1; ++j)
+				{
+					suml += keys[j].second;
+					++popl;
+					if (keys[j].first == keys[j + 1].first) continue;
+					gap(keys[j].first, keys[j + 1].first);
 				}
 			}
 		}
@@ -77,15 +140,22 @@ void tree::train(const size_t mtry, const function<double()> u01)
 		// Do not split the node if purity does not increase.
 		if (bestChildNodePurity == n.p) continue;
 
-		// Create two child nodes and distribute samples.
+		// Create two child nodes, and distribute samples by partitioning the range of the node in place.
+		const size_t var = n.var;
+		const float val = n.val;
+		const size_t mid = partition(samples.begin() + n.begin, samples.begin() + n.end, [var, val](const size_t s)
+		{
+			return !(x[s][var] > val);
+		}) - samples.begin();
 		n.children[0] = size();
+		n.children[1] = size() + 1;
+		const size_t b0 = n.begin, e1 = n.end;
 		emplace_back();
-		n.children[1] = size();
+		back().begin = b0;
+		back().end = mid;
 		emplace_back();
-		for (const size_t s : n.samples)
-		{
-			(*this)[n.children[x[s][n.var] > n.val]].samples.push_back(s);
-		}
+		back().begin = mid;
+		back().end = e1;
 	}
 }
 
@@ -98,18 +168,20 @@ float tree::operator()(const array<float, nv>& x) const
 
 void tree::clear()
 {
-	for (node& n : *this)
-	{
-		n.samples.clear();
-	}
+	vector<size_t>().swap(samples);
 }
 
-forest::forest(const size_t nt, const size_t seed) : vector<tree>(nt), nt_inv(1.0f / nt), rng(seed), uniform_01(0, 1), u01_s([&]()
+forest::forest(const size_t nt, const size_t seed) : vector<tree>(nt), nt_inv(1.0f / nt), s(seed)
 {
-	lock_guard<mutex> guard(m);
-	return uniform_01(rng);
-})
+}
+
+size_t forest::seed(const size_t i) const
 {
+	// Mix the seed of the forest and the tree index with the finalizer of splitmix64, so that trees of nearby indices or forests of nearby seeds draw unrelated sequences.
+	size_t z = s + (i + 1) * 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
 }
 
 float forest::operator()(const array<float, tree::nv>& x) const
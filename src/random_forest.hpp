@@ -5,14 +5,15 @@
 #include <vector>
 #include <array>
 #include <random>
-#include <mutex>
+#include <cstdint>
 using namespace std;
 
 //! Represents a node in a tree.
 class node
 {
 public:
-	vector<size_t> samples; //!< Node samples.
+	size_t begin; //!< Index of the first node sample in the sample arena of the tree.
+	size_t end; //!< Index past the last node sample in the sample arena of the tree.
 	float y; //!< Average of y values of node samples.
 	float p; //!< Node purity, measured as either y * y * nSamples or sum * sum / nSamples.
 	size_t var; //!< Variable used for node split.
@@ -29,8 +30,8 @@ class tree : public vector<node>
 public:
 	static const size_t nv = 42; //!< Number of variables.
 
-	//! Trains an empty tree from bootstrap samples.
-	void train(const size_t mtry, const function<double()> u01);
+	//! Trains an empty tree from bootstrap samples drawn by a random generator of its own seed.
+	void train(const size_t mtry, const size_t seed);
 
 	//! Predicts the y value of the given sample x.
 	float operator()(const array<float, nv>& x) const;
@@ -41,6 +42,22 @@ private:
 	static const size_t ns = 3444; //!< Number of training samples.
 	static const array<array<float, nv>, ns> x; //!< Features of training samples.
 	static const array<float, ns> y; //!< Measured binding affinities of training samples.
+
+	//! Represents the training samples presorted by every variable, i.e. the rank of every sample among the distinct values of a variable, so that split finding accumulates a histogram over ranks or sorts integer ranks instead of sorting samples by indirect comparison at every node.
+	class ranking
+	{
+	public:
+		//! Ranks the training samples by every variable.
+		explicit ranking();
+
+		array<array<uint16_t, ns>, nv> ranks; //!< Rank of every training sample by every variable.
+		array<vector<float>, nv> values; //!< Distinct values of every variable in ascending order.
+	};
+
+	//! Returns the ranking of the training samples, computed once on first use and shared by all trees.
+	static const ranking& presorted();
+
+	vector<size_t> samples; //!< Arena of node samples, where every node holds a range partitioned in place into the ranges of its two child nodes.
 };
 
 //! Represents a random forest.
@@ -50,19 +67,18 @@ public:
 	//! Constructs a random forest of a number of empty trees.
 	forest(const size_t nt, const size_t seed);
 
+	//! Returns the seed of the random generator of tree i, derived from the seed of the forest, so that trees are trained independently and reproducibly in any order.
+	size_t seed(const size_t i) const;
+
 	//! Predicts the y value of the given sample x.
 	float operator()(const array<float, tree::nv>& x) const;
 
 	//! Clears node samples to save memory.
 	void clear();
 
-	//! Returns a random value from uniform distribution in [0, 1) in a thread safe manner.
-	const function<double()> u01_s;
 private:
 	float nt_inv; //!< Inverse of the number of trees.
-	mt19937_64 rng;
-	uniform_real_distribution<double> uniform_01; //!< double is required because float could possibly generate 1.
-	mutable mutex m;
+	size_t s; //!< Seed of the forest.
 };
 
 #endif
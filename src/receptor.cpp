@@ -4,7 +4,7 @@
 #include "scoring_function.hpp"
 #include "receptor.hpp"
 
-receptor::receptor(const path& p, const array<float, 3>& center, const array<float, 3>& size, const float granularity) : center(center), size(size), corner0(center - 0.5f * size), corner1(corner0 + size), granularity(granularity), granularity_inverse(1.0f / granularity), num_probes({static_cast<int>(size[0] * granularity_inverse) + 2, static_cast<int>(size[1] * granularity_inverse) + 2, static_cast<int>(size[2] * granularity_inverse) + 2}), num_probes_product(num_probes[0] * num_probes[1] * num_probes[2]), map_bytes(sizeof(float) * num_probes_product), p_offset(scoring_function::n), maps(scoring_function::n)
+receptor::receptor(const path& p, const array<float, 3>& center, const array<float, 3>& size, const float granularity) : center(center), size(size), corner0(center - 0.5f * size), corner1(corner0 + size), granularity(granularity), granularity_inverse(1.0f / granularity), num_probes({static_cast<int>(size[0] * granularity_inverse) + 2, static_cast<int>(size[1] * granularity_inverse) + 2, static_cast<int>(size[2] * granularity_inverse) + 2}), num_probes_product(static_cast<size_t>(num_probes[0]) * num_probes[1] * num_probes[2]), map_bytes(sizeof(float) * num_probes_product), p_offset(scoring_function::n), maps(scoring_function::n)
 {
 	// Parse the receptor line by line.
 	atoms.reserve(2000); // A receptor typically consists of <= 2,000 atoms within bound.
@@ -103,6 +103,10 @@ receptor::receptor(const path& p, const array<float, 3>& center, const array<flo
 	}
 }
 
+receptor::receptor(const receptor& r, const float granularity) : atoms(r.atoms), center(r.center), size(r.size), corner0(r.corner0), corner1(r.corner1), granularity(granularity), granularity_inverse(1.0f / granularity), num_probes({static_cast<int>(size[0] * granularity_inverse) + 2, static_cast<int>(size[1] * granularity_inverse) + 2, static_cast<int>(size[2] * granularity_inverse) + 2}), num_probes_product(static_cast<size_t>(num_probes[0]) * num_probes[1] * num_probes[2]), map_bytes(sizeof(float) * num_probes_product), p_offset(scoring_function::n), maps(scoring_function::n)
+{
+}
+
 void receptor::precalculate(const scoring_function& sf, const vector<size_t>& xs)
 {
 	const size_t nxs = xs.size();
@@ -2,9 +2,11 @@
 #ifndef IDOCK_RECEPTOR_HPP
 #define IDOCK_RECEPTOR_HPP
 
+#include <memory>
 #include <boost/filesystem/path.hpp>
 #include "atom.hpp"
 #include "scoring_function.hpp"
+#include "brick_maps.hpp"
 using namespace boost::filesystem;
 
 //! Represents a receptor.
@@ -23,10 +25,15 @@ public:
 	const size_t map_bytes; //!< Number of bytes in a map.
 	vector<vector<size_t>> p_offset; //!< Auxiliary precalculated constants to accelerate grid map creation.
 	vector<vector<float>> maps; //!< Grid maps.
+	unique_ptr<receptor> coarse; //!< Receptor of the same atoms and box with grid maps of a coarser granularity for the early generations of Monte Carlo tasks, or null.
+	unique_ptr<brick_maps> bricks; //!< Sparse grid maps in place of the dense maps, or null.
 
 	//! Constructs a receptor by parsing a receptor file in PDBQT format.
 	explicit receptor(const path& p, const array<float, 3>& center, const array<float, 3>& size, const float granularity);
 
+	//! Constructs a receptor of the atoms and box of another receptor with empty grid maps of a different granularity.
+	explicit receptor(const receptor& r, const float granularity);
+
 	//! Precalculates auxiliary constants to accelerate grid map creation.
 	void precalculate(const scoring_function& sf, const vector<size_t>& xs);
 
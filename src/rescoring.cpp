@@ -0,0 +1,179 @@
+#include <cassert>
+#include <stdexcept>
+#include <algorithm>
+#include "array.hpp"
+#include "ligand.hpp"
+#include "rescoring.hpp"
+
+//! Represents the RF-Score scorer, which predicts pKd by the random forest from the RF-Score atom type pair counts within 12 Angstrom, the five Vina terms within 8 Angstrom and the flexibility penalty.
+class rf_scorer : public rescorer
+{
+public:
+	explicit rf_scorer(const forest& f) : f(f) {}
+
+	string name() const
+	{
+		return "rf";
+	}
+
+	float cutoff() const
+	{
+		return 12;
+	}
+
+	float operator()(const ligand& lig, const receptor& rec, const vector<neighbour>& neighbours) const
+	{
+		array<float, tree::nv> x{};
+		for (const neighbour& n : neighbours)
+		{
+			if (n.r2 >= 144) continue; // RF-Score cutoff 12A
+			const atom& la = lig.atoms[n.i];
+			const atom& ra = rec.atoms[n.j];
+			if (!la.rf_unsupported() && !ra.rf_unsupported())
+			{
+				++x[(la.rf << 2) + ra.rf];
+			}
+			if (n.r2 >= 64) continue; // Vina score cutoff 8A
+			if (!la.xs_unsupported() && !ra.xs_unsupported())
+			{
+				scoring_function::score(x.data() + 36, la.xs, ra.xs, n.r2);
+			}
+		}
+		x.back() = 1 / (1 + 0.05846f * (lig.nv - 6 + 0.5f * (lig.nf - 1 - (lig.nv - 6))));
+		return f(x);
+	}
+private:
+	const forest& f;
+};
+
+//! Represents the Vina scorer, which sums the intermolecular free energy of the precalculated scoring function, tabulated at scoring_function::ns samples per square Angstrom, looked up at the squared distances of the atom pairs instead of at the grid map probes.
+class vina_scorer : public rescorer
+{
+public:
+	explicit vina_scorer(const scoring_function& sf) : sf(sf) {}
+
+	string name() const
+	{
+		return "vina";
+	}
+
+	float cutoff() const
+	{
+		return scoring_function::cutoff;
+	}
+
+	float operator()(const ligand& lig, const receptor& rec, const vector<neighbour>& neighbours) const
+	{
+		float e = 0;
+		for (const neighbour& n : neighbours)
+		{
+			if (n.r2 >= scoring_function::cutoff_sqr) continue;
+			const atom& la = lig.atoms[n.i];
+			const atom& ra = rec.atoms[n.j];
+			if (la.xs_unsupported() || ra.xs_unsupported()) continue;
+			e += sf.e[sf.nr * mp(la.xs, ra.xs) + static_cast<size_t>(sf.ns * n.r2)];
+		}
+		return e;
+	}
+private:
+	const scoring_function& sf;
+};
+
+//! Represents the contact scorer, which counts the pairs of ligand heavy atoms and receptor atoms within 4 Angstrom.
+class contacts_scorer : public rescorer
+{
+public:
+	string name() const
+	{
+		return "contacts";
+	}
+
+	float cutoff() const
+	{
+		return 4;
+	}
+
+	float operator()(const ligand&, const receptor&, const vector<neighbour>& neighbours) const
+	{
+		return static_cast<float>(count_if(neighbours.cbegin(), neighbours.cend(), [](const neighbour& n)
+		{
+			return n.r2 < 16;
+		}));
+	}
+};
+
+const float rescoring::max_cutoff = 12;
+const array<string, 3> rescoring::builtin = {{ "rf", "vina", "contacts" }};
+
+rescoring::rescoring() : cutoff(0)
+{
+}
+
+rescoring::rescoring(const vector<string>& names, const forest& f, const scoring_function& sf) : cutoff(0)
+{
+	for (const string& name : names)
+	{
+		if (name == "rf") add(unique_ptr<rescorer>(new rf_scorer(f)));
+		else if (name == "vina") add(unique_ptr<rescorer>(new vina_scorer(sf)));
+		else if (name == "contacts") add(unique_ptr<rescorer>(new contacts_scorer));
+		else throw invalid_argument("Unknown scorer " + name);
+	}
+}
+
+void rescoring::add(unique_ptr<rescorer>&& s)
+{
+	assert(s->cutoff() <= max_cutoff);
+	cutoff = max(cutoff, s->cutoff());
+	scorers.push_back(move(s));
+}
+
+vector<string> rescoring::names() const
+{
+	vector<string> n;
+	for (const auto& s : scorers)
+	{
+		n.push_back(s->name());
+	}
+	return n;
+}
+
+vector<float> rescoring::operator()(const ligand& lig, const vector<array<float, 3>>& c, const receptor& rec) const
+{
+	vector<float> scores;
+	if (scorers.empty()) return scores;
+
+	// Collect the receptor atoms within the largest cutoff of the bounding box of the conformation.
+	array<float, 3> corner0 = c.front(), corner1 = c.front();
+	for (const array<float, 3>& a : c)
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			corner0[k] = min(corner0[k], a[k]);
+			corner1[k] = max(corner1[k], a[k]);
+		}
+	}
+	vector<size_t> candidates;
+	for (size_t j = 0; j < rec.atoms.size(); ++j)
+	{
+		const array<float, 3>& r = rec.atoms[j].coord;
+		if (r[0] > corner0[0] - cutoff && r[0] < corner1[0] + cutoff && r[1] > corner0[1] - cutoff && r[1] < corner1[1] + cutoff && r[2] > corner0[2] - cutoff && r[2] < corner1[2] + cutoff) candidates.push_back(j);
+	}
+
+	// Gather the neighbours of every ligand heavy atom once, and feed them to every scorer.
+	const float cutoff_sqr = cutoff * cutoff;
+	vector<neighbour> neighbours;
+	for (size_t i = 0; i < lig.na; ++i)
+	{
+		for (const size_t j : candidates)
+		{
+			const float r2 = distance_sqr(c[i], rec.atoms[j].coord);
+			if (r2 < cutoff_sqr) neighbours.push_back({ i, j, r2 });
+		}
+	}
+	scores.reserve(scorers.size());
+	for (const auto& s : scorers)
+	{
+		scores.push_back((*s)(lig, rec, neighbours));
+	}
+	return scores;
+}
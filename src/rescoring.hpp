@@ -0,0 +1,70 @@
+#pragma once
+#ifndef IDOCK_RESCORING_HPP
+#define IDOCK_RESCORING_HPP
+
+#include <memory>
+#include <string>
+#include "scoring_function.hpp"
+#include "random_forest.hpp"
+#include "receptor.hpp"
+
+class ligand;
+
+//! Represents a receptor atom near a heavy atom of a ligand conformation.
+class neighbour
+{
+public:
+	size_t i; //!< Index of the ligand heavy atom.
+	size_t j; //!< Index of the receptor atom.
+	float r2; //!< Square of their distance.
+};
+
+//! Represents a scorer of ligand conformations for consensus ranking, which scores a conformation from its receptor neighbours gathered once for all scorers.
+class rescorer
+{
+public:
+	virtual ~rescorer() {}
+
+	//! Returns the name of the scorer, which heads its columns in the log.
+	virtual string name() const = 0;
+
+	//! Returns the distance cutoff in Angstrom of the interactions considered by the scorer, at most rescoring::max_cutoff.
+	virtual float cutoff() const = 0;
+
+	//! Scores a conformation of lig against rec from its receptor neighbours, gathered in ascending order of ligand and then receptor atom index within the largest cutoff of all registered scorers, and therefore to be filtered by the cutoff of the scorer.
+	virtual float operator()(const ligand& lig, const receptor& rec, const vector<neighbour>& neighbours) const = 0;
+};
+
+//! Represents a consensus rescoring stage, which gathers the receptor neighbours of a ligand conformation in one pass within the largest cutoff of its registered scorers, and feeds them to every scorer.
+class rescoring
+{
+public:
+	static const float max_cutoff; //!< Largest cutoff of a scorer, i.e. the 12 Angstrom of RF-Score.
+	static const array<string, 3> builtin; //!< Names of the built-in scorers, i.e. rf for the pKd predicted by the random forest from RF-Score features, vina for the intermolecular free energy looked up in the precalculated scoring function at the atom pair distances instead of the grid maps, and contacts for the number of pairs of ligand heavy atoms and receptor atoms within 4 Angstrom.
+
+	//! Constructs a rescoring stage of no scorers.
+	explicit rescoring();
+
+	//! Constructs a rescoring stage of the built-in scorers of the given names, whose rf and vina scorers use f and sf. Throws invalid_argument on an unknown name.
+	explicit rescoring(const vector<string>& names, const forest& f, const scoring_function& sf);
+
+	//! Registers a scorer, whose scores follow those of the scorers registered before.
+	void add(unique_ptr<rescorer>&& s);
+
+	//! Returns the names of the registered scorers in their order of registration.
+	vector<string> names() const;
+
+	//! Returns true if no scorer is registered.
+	bool empty() const
+	{
+		return scorers.empty();
+	}
+
+	//! Returns the scores of conformation c of lig against rec by the registered scorers in their order of registration.
+	vector<float> operator()(const ligand& lig, const vector<array<float, 3>>& c, const receptor& rec) const;
+private:
+	vector<unique_ptr<rescorer>> scorers; //!< Registered scorers.
+	float cutoff; //!< Largest cutoff of the registered scorers.
+};
+
+#endif
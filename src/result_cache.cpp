@@ -0,0 +1,94 @@
+#include <iomanip>
+#include <sstream>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include "result_cache.hpp"
+
+namespace
+{
+	//! Format version of cached values, to be bumped whenever the scoring function, the kernel or the value layout changes.
+	const size_t version = 1;
+
+	//! Accumulates the bytes of an object into a 64-bit FNV-1a hash.
+	void fnv1a(size_t& h, const void* const p, const size_t n)
+	{
+		const unsigned char* const b = static_cast<const unsigned char*>(p);
+		for (size_t i = 0; i < n; ++i)
+		{
+			h = (h ^ b[i]) * 1099511628211ULL;
+		}
+	}
+
+	template <typename T>
+	void fnv1a(size_t& h, const T& v)
+	{
+		fnv1a(h, &v, sizeof(v));
+	}
+}
+
+result_cache::result_cache(const path& folder) : folder(folder)
+{
+	create_directories(folder);
+}
+
+size_t result_cache::hash(const receptor& rec)
+{
+	size_t h = 14695981039346656037ULL;
+	fnv1a(h, version);
+	for (const atom& a : rec.atoms)
+	{
+		fnv1a(h, a.coord);
+		fnv1a(h, a.xs);
+		fnv1a(h, a.rf);
+	}
+	fnv1a(h, rec.corner0);
+	fnv1a(h, rec.corner1);
+	fnv1a(h, rec.granularity);
+	if (rec.bricks) fnv1a(h, brick_maps::side);
+	return h;
+}
+
+string result_cache::key(const size_t h, const int* const ligh, const size_t n, const size_t num_tasks, const size_t nbi, const size_t ncg, const float cgr, const size_t seed)
+{
+	size_t k = h;
+	fnv1a(k, n);
+	fnv1a(k, ligh, sizeof(int) * n);
+	fnv1a(k, num_tasks);
+	fnv1a(k, nbi);
+	if (ncg)
+	{
+		fnv1a(k, ncg);
+		fnv1a(k, cgr);
+	}
+	fnv1a(k, seed);
+	ostringstream oss;
+	oss << hex << setw(16) << setfill('0') << k;
+	return oss.str();
+}
+
+bool result_cache::load(const string& key, vector<float>& cnfh, search_statistics& st) const
+{
+	boost::filesystem::ifstream ifs(folder / key.substr(0, 2) / key, ios::binary);
+	if (!ifs) return false;
+	size_t v, n;
+	if (!ifs.read(reinterpret_cast<char*>(&v), sizeof(v)) || v != version) return false;
+	if (!ifs.read(reinterpret_cast<char*>(&n), sizeof(n))) return false;
+	cnfh.resize(n);
+	return ifs.read(reinterpret_cast<char*>(cnfh.data()), sizeof(float) * n) && ifs.read(reinterpret_cast<char*>(&st), sizeof(st));
+}
+
+void result_cache::store(const string& key, const vector<float>& cnfh, const search_statistics& st) const
+{
+	const path subfolder = folder / key.substr(0, 2);
+	create_directories(subfolder);
+	const path tmp = subfolder / unique_path(key + ".%%%%%%%%.tmp");
+	{
+		boost::filesystem::ofstream ofs(tmp, ios::binary);
+		const size_t n = cnfh.size();
+		ofs.write(reinterpret_cast<const char*>(&version), sizeof(version));
+		ofs.write(reinterpret_cast<const char*>(&n), sizeof(n));
+		ofs.write(reinterpret_cast<const char*>(cnfh.data()), sizeof(float) * n);
+		ofs.write(reinterpret_cast<const char*>(&st), sizeof(st));
+	}
+	rename(tmp, subfolder / key);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#ifndef IDOCK_RESULT_CACHE_HPP
+#define IDOCK_RESULT_CACHE_HPP
+
+#include "receptor.hpp"
+#include "kernel.hpp"
+
+//! Represents an on-disk content-addressed cache of docking results across runs. A value holds the conformations of the Monte Carlo tasks of a ligand and their search statistics. Its key is a hash of the ligand encoding, the receptor atoms, the search space, the granularity, the number of tasks and generations, the coarse generations and granularity if any, and the random seed. A value lives in its own file under a subfolder named after the first two hexadecimal digits of its key, and is written to a temporary file first and renamed, so that concurrent runs may share a cache.
+class result_cache
+{
+public:
+	//! Constructs a cache in a folder, creating the folder if necessary.
+	explicit result_cache(const path& folder);
+
+	//! Returns the hash of the receptor atoms, search space, granularity and sparsity of the grid maps of a receptor, to be combined with ligands into keys.
+	static size_t hash(const receptor& rec);
+
+	//! Returns the key of a ligand encoding of n elements docked against a receptor of hash h with num_tasks tasks of nbi generations, the first ncg of which on coarse grid maps of granularity cgr, and a seed.
+	static string key(const size_t h, const int* const ligh, const size_t n, const size_t num_tasks, const size_t nbi, const size_t ncg, const float cgr, const size_t seed);
+
+	//! Loads the conformations and search statistics of a key into cnfh and st, and returns false on a miss.
+	bool load(const string& key, vector<float>& cnfh, search_statistics& st) const;
+
+	//! Stores the conformations and search statistics of a key, overwriting any existing value.
+	void store(const string& key, const vector<float>& cnfh, const search_statistics& st) const;
+
+	const path folder; //!< Folder of cached values.
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include <cmath>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include "rmsd.hpp"
+
+//! Element strings. AutoDock4 atom types that share an element are merged, e.g. A into C, NA into N, OA into O and SA into S.
+static const array<string, 21> element_strings =
+{
+	"C", "N", "O", "S", "Se", "P", "F", "Cl", "Br", "I", "Zn", "Fe", "Mg", "Ca", "Mn", "Cu", "Na", "K", "Hg", "Ni", "Co",
+};
+
+//! Covalent radii of elements, factorized by 1.1 for extra allowance.
+static const array<float, 21> element_covalent_radii =
+{
+	0.847f, 0.825f, 0.803f, 1.122f, 1.276f, 1.166f, 0.781f, 1.089f, 1.254f, 1.463f, 1.441f, 1.375f, 1.430f, 1.914f, 1.529f, 1.518f, 1.694f, 2.156f, 1.639f, 1.331f, 1.386f,
+};
+
+//! Returns the element index of an AutoDock4 atom type string, or element_strings.size() if not found.
+static size_t ad_to_element(const string& ad)
+{
+	const string e = ad == "A" ? "C" : ad == "NA" ? "N" : ad == "OA" ? "O" : ad == "SA" ? "S" : ad;
+	return find(element_strings.cbegin(), element_strings.cend(), e) - element_strings.cbegin();
+}
+
+rmsd_molecule::rmsd_molecule(istream& is) : na(0), stride(0)
+{
+	vector<float> x, y, z;
+	const auto end_pose = [&]()
+	{
+		if (x.empty()) return;
+		if (poses.empty())
+		{
+			na = x.size();
+			stride = (na + w - 1) / w * w;
+		}
+		if (x.size() == na)
+		{
+			vector<float> p(3 * stride);
+			copy(x.cbegin(), x.cend(), p.begin());
+			copy(y.cbegin(), y.cend(), p.begin() + stride);
+			copy(z.cbegin(), z.cend(), p.begin() + 2 * stride);
+			poses.push_back(move(p));
+		}
+		x.clear();
+		y.clear();
+		z.clear();
+	};
+	for (string line; getline(is, line);)
+	{
+		const string record = line.substr(0, 6);
+		if (record == "ATOM  " || record == "HETATM")
+		{
+			if (line.size() < 78) continue;
+			const string ad = line.substr(77, isspace(line[78]) ? 1 : 2);
+			if (ad == "H" || ad == "HD") continue;
+			if (poses.empty()) elements.push_back(ad_to_element(ad));
+			x.push_back(stof(line.substr(30, 8)));
+			y.push_back(stof(line.substr(38, 8)));
+			z.push_back(stof(line.substr(46, 8)));
+		}
+		else if (record == "TORSDO" || record == "ENDMDL")
+		{
+			end_pose();
+		}
+	}
+	end_pose();
+	elements.resize(na);
+
+	// Perceive covalent bonds from the first pose.
+	bonded.assign(na, vector<bool>(na));
+	if (poses.empty()) return;
+	const vector<float>& p = poses.front();
+	for (size_t i = 0; i < na; ++i)
+	{
+		const float ri = elements[i] < element_covalent_radii.size() ? element_covalent_radii[elements[i]] : 1.5f;
+		for (size_t j = 0; j < i; ++j)
+		{
+			const float rj = elements[j] < element_covalent_radii.size() ? element_covalent_radii[elements[j]] : 1.5f;
+			const float d0 = p[i] - p[j];
+			const float d1 = p[stride + i] - p[stride + j];
+			const float d2 = p[2 * stride + i] - p[2 * stride + j];
+			const float s = ri + rj;
+			bonded[i][j] = bonded[j][i] = d0 * d0 + d1 * d1 + d2 * d2 < s * s;
+		}
+	}
+}
+
+size_t rmsd_molecule::degree(const size_t i) const
+{
+	return count(bonded[i].cbegin(), bonded[i].cend(), true);
+}
+
+vector<vector<size_t>> isomorphisms(const rmsd_molecule& a, const rmsd_molecule& b, const size_t max_mappings)
+{
+	vector<vector<size_t>> mappings;
+	const size_t n = a.na;
+	if (n != b.na || !n) return mappings;
+
+	// Visit atoms of a in breadth first order so that most candidates are pruned by their already mapped neighbors.
+	vector<size_t> order;
+	order.reserve(n);
+	vector<bool> visited(n);
+	for (size_t s = 0; s < n; ++s)
+	{
+		if (visited[s]) continue;
+		visited[s] = true;
+		order.push_back(s);
+		for (size_t k = order.size() - 1; k < order.size(); ++k)
+		{
+			for (size_t j = 0; j < n; ++j)
+			{
+				if (a.bonded[order[k]][j] && !visited[j])
+				{
+					visited[j] = true;
+					order.push_back(j);
+				}
+			}
+		}
+	}
+
+	vector<size_t> da(n), db(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		da[i] = a.degree(i);
+		db[i] = b.degree(i);
+	}
+
+	// Backtrack over candidates of the same element and degree whose bonds to already mapped atoms are preserved. The search is iterative to avoid deep recursion.
+	vector<size_t> m(n, n), candidate(n, 0);
+	vector<bool> used(n);
+	for (size_t k = 0; k < n && mappings.size() < max_mappings;)
+	{
+		const size_t i = order[k];
+		if (m[i] < n)
+		{
+			used[m[i]] = false;
+			m[i] = n;
+		}
+		size_t c;
+		for (c = candidate[k]; c < n; ++c)
+		{
+			if (used[c] || a.elements[i] != b.elements[c] || da[i] != db[c]) continue;
+			bool consistent = true;
+			for (size_t l = 0; l < k && consistent; ++l)
+			{
+				const size_t j = order[l];
+				consistent = a.bonded[i][j] == b.bonded[c][m[j]];
+			}
+			if (consistent) break;
+		}
+		if (c == n)
+		{
+			// Exhausted all candidates of the current atom. Backtrack.
+			candidate[k] = 0;
+			if (!k) break;
+			--k;
+			continue;
+		}
+		m[i] = c;
+		used[c] = true;
+		candidate[k] = c + 1;
+		if (k + 1 < n)
+		{
+			++k;
+			continue;
+		}
+		mappings.push_back(m);
+	}
+	return mappings;
+}
+
+void permute(const float* const a, const vector<size_t>& m, const size_t stride, float* const p)
+{
+	fill(p, p + 3 * stride, 0.0f);
+	for (size_t i = 0; i < m.size(); ++i)
+	{
+		p[m[i]]              = a[i];
+		p[m[i] + stride]     = a[i + stride];
+		p[m[i] + 2 * stride] = a[i + 2 * stride];
+	}
+}
+
+float square_deviation(const float* const a, const float* const b, const size_t stride)
+{
+	const size_t w = rmsd_molecule::w;
+	array<float, rmsd_molecule::w> s{};
+	for (size_t i = 0, n = 3 * stride; i < n; i += w)
+	{
+		for (size_t l = 0; l < w; ++l)
+		{
+			const float d = a[i + l] - b[i + l];
+			s[l] += d * d;
+		}
+	}
+	float sum = 0;
+	for (size_t l = 0; l < w; ++l) sum += s[l];
+	return sum;
+}
+
+float rmsd(const vector<vector<float>>& permuted_refs, const float* const p, const size_t stride, const size_t na)
+{
+	float best = numeric_limits<float>::max();
+	for (const vector<float>& r : permuted_refs)
+	{
+		best = min(best, square_deviation(r.data(), p, stride));
+	}
+	return sqrt(best / na);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#ifndef IDOCK_RMSD_HPP
+#define IDOCK_RMSD_HPP
+
+#include <vector>
+#include <string>
+#include <istream>
+using namespace std;
+
+//! Represents the heavy atoms of one or more poses of a molecule, e.g. a crystal ligand or the models of a docked ligand, for RMSD calculation.
+class rmsd_molecule
+{
+public:
+	static const size_t w = 8; //!< SIMD width. Coordinates are padded with zeros to a multiple of w.
+	vector<size_t> elements; //!< Element of each heavy atom, with aromatic and acceptor variants of AutoDock4 atom types merged, e.g. A and C, OA and O.
+	vector<vector<bool>> bonded; //!< Adjacency matrix of covalent bonds, perceived from the first pose.
+	size_t na; //!< Number of heavy atoms.
+	size_t stride; //!< Number of floats per dimension of a pose, i.e. na rounded up to a multiple of w.
+	vector<vector<float>> poses; //!< Pose coordinates in structure of arrays layout, i.e. x[stride], y[stride], z[stride].
+
+	//! Constructs a molecule by parsing PDBQT ATOM/HETATM lines of heavy atoms. A new pose begins after every TORSDOF or ENDMDL line.
+	explicit rmsd_molecule(istream& is);
+
+	//! Returns the number of bonds of atom i.
+	size_t degree(const size_t i) const;
+};
+
+//! Returns up to max_mappings bond preserving atom mappings m from a to b, i.e. atom i of a corresponds to atom m[i] of b. Automorphisms are obtained when a and b are the same molecule.
+vector<vector<size_t>> isomorphisms(const rmsd_molecule& a, const rmsd_molecule& b, const size_t max_mappings = 10000);
+
+//! Permutes pose a of n atoms by mapping m into pose p, i.e. p[m[i]] = a[i], so that p can be compared with poses of b atom by atom.
+void permute(const float* const a, const vector<size_t>& m, const size_t stride, float* const p);
+
+//! Returns the sum of square deviations of two padded poses of a given stride. The loop is written in w independent lanes so that it vectorizes without reassociating floating point additions.
+float square_deviation(const float* const a, const float* const b, const size_t stride);
+
+//! Returns the symmetry corrected RMSD between pose p of b and the reference a, whose poses have been permuted by every mapping in advance.
+float rmsd(const vector<vector<float>>& permuted_refs, const float* const p, const size_t stride, const size_t na);
+
+#endif
@@ -1,8 +1,14 @@
 #include "safe_class.hpp"
+#include "tracer.hpp"
 
 void safe_function::operator()(function<void(void)>&& f)
 {
-	lock_guard<mutex> guard(m);
+	{
+		trace_scope ts("safe_function::lock");
+		m.lock();
+	}
+	lock_guard<mutex> guard(m, adopt_lock);
+	trace_scope ts("safe_function::call");
 	f();
 }
 
@@ -23,10 +29,20 @@ void safe_counter<T>::increment()
 template <typename T>
 void safe_counter<T>::wait()
 {
+	trace_scope ts("safe_counter::wait");
 	unique_lock<mutex> lock(m);
 	if (i < n) cv.wait(lock);
 }
 
+template <typename T>
+void safe_counter<T>::wait(const T z)
+{
+	trace_scope ts("safe_counter::wait");
+	unique_lock<mutex> lock(m);
+	n = z;
+	while (i < n) cv.wait(lock);
+}
+
 template class safe_counter<size_t>;
 
 template <typename T>
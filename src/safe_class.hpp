@@ -30,6 +30,9 @@ public:
 
 	//! Waits until the counter reaches its expected hit value.
 	void wait();
+
+	//! Sets the expected hit value to z, possibly after increments have started, and waits until the counter reaches it.
+	void wait(const T z);
 private:
 	mutex m;
 	condition_variable cv;
@@ -37,6 +40,24 @@ private:
 	T i; //!< Counter value.
 };
 
+//! Represents a guard that waits until a thread safe counter reaches the number of increments expected by then when it goes out of scope, so that posted work referring to local variables completes also when an exception is thrown.
+template <typename T>
+class safe_counter_guard
+{
+public:
+	//! Guards counter c, whose expected hit value is read from n upon destruction.
+	explicit safe_counter_guard(safe_counter<T>& c, const T& n) : c(c), n(n) {}
+
+	//! Waits until the counter reaches n.
+	~safe_counter_guard()
+	{
+		c.wait(n);
+	}
+private:
+	safe_counter<T>& c;
+	const T& n;
+};
+
 //! Represents a thread safe vector.
 template <typename T>
 class safe_vector : public vector<T>
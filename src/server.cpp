@@ -0,0 +1,269 @@
+#include <deque>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/filesystem/operations.hpp>
+#include "server.hpp"
+
+server::server(docking_session& session, const docking_options& default_options, const float default_granularity) : session(session), default_options(default_options), default_granularity(default_granularity)
+{
+}
+
+void server::dock(const map<string, vector<string>>& job, ostream& os)
+{
+	// Returns the single value of an option, or the default value if absent.
+	const auto value = [&](const string& key, const string& default_value) -> string
+	{
+		const auto it = job.find(key);
+		return it == job.cend() ? default_value : it->second.back();
+	};
+	const auto required = [&](const string& key) -> string
+	{
+		const auto it = job.find(key);
+		if (it == job.cend()) throw runtime_error("The option '" + key + "' is required but missing");
+		return it->second.back();
+	};
+
+	// Require the paths given by the job to be absolute, as relative paths would resolve against the working folder of the daemon rather than that of the client.
+	for (const string key : { "receptor", "input", "output_folder", "log", "cache" })
+	{
+		const auto it = job.find(key);
+		if (it == job.cend()) continue;
+		for (const string& p : it->second)
+		{
+			if (!path(p).is_absolute()) throw runtime_error("The option '" + key + "' must be an absolute path");
+		}
+	}
+
+	// Parse and validate the options.
+	const path receptor_path = required("receptor");
+	if (!is_regular_file(receptor_path)) throw runtime_error("Receptor " + receptor_path.string() + " does not exist or is not a regular file");
+	const array<float, 3> center = {{ stof(required("center_x")), stof(required("center_y")), stof(required("center_z")) }};
+	const array<float, 3> size = {{ stof(required("size_x")), stof(required("size_y")), stof(required("size_z")) }};
+	const float granularity = stof(value("granularity", to_string(default_granularity)));
+	const auto inputs = job.find("input");
+	if (inputs == job.cend()) throw runtime_error("The option 'input' is required but missing");
+	for (const string& input : inputs->second)
+	{
+		if (!exists(input)) throw runtime_error("Input " + input + " does not exist");
+	}
+	docking_options o;
+	o.output_folder = value("output_folder", default_options.output_folder.string());
+	o.num_tasks = stoul(value("tasks", to_string(default_options.num_tasks)));
+	o.num_bfgs_iterations = stoul(value("generations", to_string(default_options.num_bfgs_iterations)));
+	o.max_conformations = stoul(value("max_conformations", to_string(default_options.max_conformations)));
+	o.seed = stoul(value("seed", to_string(default_options.seed)));
+	o.latency = stoul(value("latency", to_string(default_options.latency))) != 0;
+	o.patience = stoul(value("patience", to_string(default_options.patience)));
+	o.report_interval = stoul(value("report", to_string(default_options.report_interval)));
+	o.report_poses = stoul(value("report_poses", to_string(default_options.report_poses))) != 0;
+	o.cache_folder = value("cache", default_options.cache_folder.string());
+	o.deduplicate = stoul(value("deduplicate", to_string(default_options.deduplicate))) != 0;
+	o.warm_start = stof(value("warm_start", to_string(default_options.warm_start)));
+	if (o.warm_start < 0 || o.warm_start > 1) throw runtime_error("The option 'warm_start' must be between 0 and 1");
+	o.coarse_generations = stoul(value("coarse_generations", to_string(default_options.coarse_generations)));
+	o.coarse_granularity = stof(value("coarse_granularity", to_string(default_options.coarse_granularity)));
+	if ((o.coarse_generations && o.coarse_generations >= o.num_bfgs_iterations) || o.coarse_granularity <= 0) throw runtime_error("The option 'coarse_generations' must be fewer than 'generations', and 'coarse_granularity' must be positive");
+	o.sparse = stoul(value("sparse", to_string(default_options.sparse))) != 0;
+	const auto rescorers = job.find("rescore");
+	o.rescorers = rescorers == job.cend() ? default_options.rescorers : rescorers->second;
+	for (const string& r : o.rescorers)
+	{
+		if (find(rescoring::builtin.cbegin(), rescoring::builtin.cend(), r) == rescoring::builtin.cend()) throw runtime_error("Unknown scorer " + r + " of the option 'rescore'");
+	}
+	if (!exists(o.output_folder)) create_directories(o.output_folder);
+
+	// Dock the ligand files and the ligands of folders in the given order.
+	profiler prof(session.num_threads);
+	log_engine log;
+	receptor& rec = session.get_receptor(receptor_path, center, size, granularity, os, prof);
+	size_t i = 0;
+	directory_iterator dir_iter;
+	const directory_iterator const_dir_iter;
+	session.dock(rec, [&](path& p)
+	{
+		while (true)
+		{
+			for (; dir_iter != const_dir_iter; ++dir_iter)
+			{
+				if (dir_iter->path().extension() != ".pdbqt") continue;
+				p = dir_iter->path();
+				++dir_iter;
+				return true;
+			}
+			if (i == inputs->second.size()) return false;
+			const path input = inputs->second[i++];
+			if (!is_directory(input))
+			{
+				p = input;
+				return true;
+			}
+			dir_iter = directory_iterator(input);
+		}
+	}, o, os, log, prof);
+
+	// Sort and write ligand log records to the log file if requested.
+	const string log_path = value("log", string());
+	if (!log_path.empty() && !log.empty())
+	{
+		log.sort();
+		log.write(log_path);
+	}
+}
+
+int server::run(const path& socket_path)
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	using boost::asio::local::stream_protocol;
+
+	// Represents a job received from a client, whose connection stays open for streaming the progress.
+	class job
+	{
+	public:
+		unique_ptr<stream_protocol::iostream> stream;
+		map<string, vector<string>> options;
+		bool shutdown;
+	};
+
+	// Listen on the socket, replacing a stale socket file left by a previous daemon.
+	io_service acceptor_service;
+	stream_protocol::acceptor acceptor(acceptor_service);
+	try
+	{
+		remove(socket_path);
+		const stream_protocol::endpoint endpoint(socket_path.string());
+		acceptor.open(endpoint.protocol());
+		acceptor.bind(endpoint);
+
+		// Let only the owner of the daemon connect, as jobs write to any path the daemon can write to.
+		permissions(socket_path, owner_read | owner_write);
+		acceptor.listen();
+	}
+	catch (const exception& e)
+	{
+		cerr << "Failed to listen on " << socket_path << ": " << e.what() << endl;
+		return 1;
+	}
+	cout << "Listening on " << socket_path << endl;
+
+	// Accept connections on a separate thread, and read the job of every connection into a queue on a thread of its own, so that clients can submit jobs while one is running and a slow client does not hold up the others. A job not completed within the read timeout is dropped, so that every reader finishes.
+	mutex m;
+	condition_variable cv;
+	deque<job> jobs;
+	bool stopping = false;
+	const std::chrono::seconds read_timeout(60);
+	thread accepting([&]()
+	{
+		vector<future<void>> readers;
+		while (true)
+		{
+			unique_ptr<stream_protocol::iostream> stream(new stream_protocol::iostream);
+			boost::system::error_code ec;
+			acceptor.accept(*stream->rdbuf(), ec);
+			{
+				lock_guard<mutex> guard(m);
+				if (stopping) break;
+			}
+			if (ec) continue;
+
+			// Forget the readers that have finished, and read the job of the connection.
+			readers.erase(remove_if(readers.begin(), readers.end(), [](const future<void>& r)
+			{
+				return r.wait_for(std::chrono::seconds(0)) == future_status::ready;
+			}), readers.end());
+			readers.push_back(async(launch::async, [&](unique_ptr<stream_protocol::iostream> stream)
+			{
+				job j;
+				j.stream = move(stream);
+				j.shutdown = false;
+				j.stream->expires_after(read_timeout);
+				for (string line; getline(*j.stream, line);)
+				{
+					if (!line.empty() && line.back() == '\r') line.pop_back();
+					if (line.empty()) break;
+					if (line == "shutdown")
+					{
+						j.shutdown = true;
+						break;
+					}
+					const size_t eq = line.find('=');
+					if (eq == string::npos) continue;
+					j.options[line.substr(0, eq)].push_back(line.substr(eq + 1));
+				}
+				if (j.stream->error() == boost::asio::error::timed_out)
+				{
+					j.stream->clear();
+					j.stream->expires_after(read_timeout);
+					*j.stream << "Error: timed out reading the job" << endl;
+					return;
+				}
+				j.stream->clear();
+				j.stream->expires_at(stream_protocol::iostream::time_point::max());
+				{
+					lock_guard<mutex> guard(m);
+					jobs.push_back(move(j));
+				}
+				cv.notify_one();
+			}, move(stream)));
+		}
+		for (auto& r : readers)
+		{
+			r.wait();
+		}
+	});
+
+	// Run the queued jobs one after another on the worker pool of the session.
+	while (true)
+	{
+		job j;
+		{
+			unique_lock<mutex> lock(m);
+			cv.wait(lock, [&]()
+			{
+				return !jobs.empty();
+			});
+			j = move(jobs.front());
+			jobs.pop_front();
+		}
+		ostream& os = *j.stream;
+		if (j.shutdown)
+		{
+			os << "Shutting down" << endl;
+
+			// Stop accepting, waking up the pending accept with a connection of its own.
+			{
+				lock_guard<mutex> guard(m);
+				stopping = true;
+			}
+			stream_protocol::iostream wake(stream_protocol::endpoint(socket_path.string()));
+			break;
+		}
+		cout << "Running a job of " << (j.options.count("input") ? j.options["input"].size() : 0) << " inputs" << endl;
+		try
+		{
+			dock(j.options, os);
+			os << "Done" << endl;
+		}
+		catch (const exception& e)
+		{
+			os << "Error: " << e.what() << endl;
+		}
+	}
+	accepting.join();
+
+	// Answer the jobs queued after the shutdown, so that their clients do not wait for them.
+	for (job& j : jobs)
+	{
+		*j.stream << "Error: the server has shut down" << endl;
+	}
+	remove(socket_path);
+	return 0;
+#else
+	cerr << "Unix domain sockets are not supported on this platform" << endl;
+	return 1;
+#endif
+}
@@ -0,0 +1,27 @@
+#pragma once
+#ifndef IDOCK_SERVER_HPP
+#define IDOCK_SERVER_HPP
+
+#include "docking_session.hpp"
+
+//! Represents a daemon serving docking jobs over a Unix domain socket with a warm docking session.
+//! A client connects, sends one option per line in the form of key=value, i.e. receptor, center_x, center_y, center_z, size_x, size_y, size_z, granularity, input, output_folder, log, tasks, generations, max_conformations, seed, latency (0 or 1), patience, report, report_poses (0 or 1), cache, deduplicate (0 or 1), warm_start, coarse_generations, coarse_granularity and sparse (0 or 1), and ends the job with an empty line within a minute of connecting. The input option, a ligand file or a folder of ligands, may be repeated.
+//! The server reads the job of every connection on a thread of its own, queues the job, streams the docking progress back, and closes the connection after a final line of either "Done" or "Error: reason". A job consisting of the single line shutdown stops the server after the jobs queued before it, and the jobs queued after it are answered with an error. Only the owner of the daemon may connect to the socket, and the paths of a job must be absolute.
+class server
+{
+public:
+	//! Constructs a server of a docking session, filling options missing from a job with defaults.
+	explicit server(docking_session& session, const docking_options& default_options, const float default_granularity);
+
+	//! Listens on a Unix domain socket, and runs queued jobs one after another on the worker pool of the session until shutdown. Returns 0 on shutdown, or 1 if the socket cannot be listened on.
+	int run(const path& socket_path);
+private:
+	//! Runs a job of options, each of which maps to its values, reporting progress and the outcome to os.
+	void dock(const map<string, vector<string>>& job, ostream& os);
+
+	docking_session& session;
+	const docking_options default_options;
+	const float default_granularity;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <iomanip>
+#include <boost/filesystem/fstream.hpp>
+#include "tracer.hpp"
+#include "profiler.hpp"
+
+namespace
+{
+	//! Represents a complete event of a name, a start time and a duration in microseconds.
+	class event
+	{
+	public:
+		const char* name;
+		double ts;
+		double dur;
+	};
+
+	//! Represents a fixed-capacity buffer of the most recent events of a thread.
+	class ring
+	{
+	public:
+		explicit ring(const size_t tid, const size_t capacity) : tid(tid), n(0), events(capacity) {}
+
+		//! Appends an event, overwriting the oldest one if the buffer is full.
+		void push(const char* const name, const double ts, const double dur)
+		{
+			event& e = events[n++ % events.size()];
+			e.name = name;
+			e.ts = ts;
+			e.dur = dur;
+		}
+
+		const size_t tid; //!< Thread index in order of registration, where 0 is the main thread.
+		size_t n; //!< Number of events recorded, including overwritten ones.
+		vector<event> events;
+	};
+
+	std::chrono::steady_clock::time_point t0;
+	size_t ring_capacity;
+	mutex rings_mutex;
+	vector<unique_ptr<ring>> rings;
+	thread_local ring* this_ring = nullptr;
+
+	//! Returns the ring buffer of the calling thread, registering one upon first use.
+	ring& get_ring()
+	{
+		if (!this_ring)
+		{
+			lock_guard<mutex> guard(rings_mutex);
+			rings.emplace_back(new ring(rings.size(), ring_capacity));
+			this_ring = rings.back().get();
+		}
+		return *this_ring;
+	}
+}
+
+atomic<bool> tracer::on(false);
+
+void tracer::enable(const size_t capacity)
+{
+	t0 = std::chrono::steady_clock::now();
+	ring_capacity = capacity;
+	get_ring();
+	on = true;
+}
+
+double tracer::now()
+{
+	return std::chrono::duration<double, micro>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void tracer::record(const char* const name, const double ts)
+{
+	get_ring().push(name, ts, now() - ts);
+}
+
+void tracer::write(const path& trace_path)
+{
+	lock_guard<mutex> guard(rings_mutex);
+	boost::filesystem::ofstream ofs(trace_path);
+	ofs.setf(ios::fixed, ios::floatfield);
+	ofs << setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	bool first = true;
+	for (const auto& r : rings)
+	{
+		ofs << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << r->tid << ", \"args\": {\"name\": " << json_string(r->tid ? "worker " + to_string(r->tid) : string("main")) << "}}";
+		first = false;
+		const size_t capacity = r->events.size();
+		for (size_t i = r->n > capacity ? r->n - capacity : 0; i < r->n; ++i)
+		{
+			const event& e = r->events[i % capacity];
+			ofs << ",\n{\"name\": " << json_string(e.name) << ", \"ph\": \"X\", \"pid\": 0, \"tid\": " << r->tid << ", \"ts\": " << e.ts << ", \"dur\": " << e.dur << '}';
+		}
+	}
+	ofs << "\n]}\n";
+}
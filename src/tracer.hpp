@@ -0,0 +1,53 @@
+#pragma once
+#ifndef IDOCK_TRACER_HPP
+#define IDOCK_TRACER_HPP
+
+#include <chrono>
+#include <atomic>
+#include <boost/filesystem/path.hpp>
+using namespace std;
+using namespace boost::filesystem;
+
+//! Represents a low-overhead event tracer. Each thread records complete events into its own ring buffer without locking, and the buffers are flushed in Chrome trace JSON format, viewable in chrome://tracing or Perfetto, after all threads have finished.
+class tracer
+{
+public:
+	//! Enables tracing with ring buffers of a number of events per thread, and registers the calling thread as the main thread.
+	static void enable(const size_t capacity);
+
+	//! Returns true if tracing is enabled.
+	static bool enabled()
+	{
+		return on.load(memory_order_relaxed);
+	}
+
+	//! Returns the current time in microseconds since tracing was enabled.
+	static double now();
+
+	//! Records an event of a statically allocated name that began at t0 and ends now, in the ring buffer of the calling thread.
+	static void record(const char* const name, const double t0);
+
+	//! Writes the events of all threads in Chrome trace JSON format. Must be called after the threads that recorded events have finished.
+	static void write(const path& trace_path);
+private:
+	static atomic<bool> on;
+};
+
+//! Represents a scope whose lifetime is recorded as an event if tracing is enabled.
+class trace_scope
+{
+public:
+	//! Begins an event of a statically allocated name.
+	explicit trace_scope(const char* const name) : name(name), t0(tracer::enabled() ? tracer::now() : 0) {}
+
+	//! Ends the event.
+	~trace_scope()
+	{
+		if (tracer::enabled()) tracer::record(name, t0);
+	}
+private:
+	const char* const name;
+	const double t0;
+};
+
+#endif
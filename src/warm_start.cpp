@@ -0,0 +1,169 @@
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include "array.hpp"
+#include "warm_start.hpp"
+
+namespace
+{
+	//! Returns the unit quaternion of the rotation that best superimposes the points a onto the points b, both centered at their centroids, as the eigenvector of the largest eigenvalue of Horn's symmetric 4x4 matrix found by Jacobi rotations.
+	array<float, 4> superimpose(const vector<array<double, 3>>& a, const vector<array<double, 3>>& b)
+	{
+		array<array<double, 3>, 3> s = {};
+		for (size_t i = 0; i < a.size(); ++i)
+		for (size_t j = 0; j < 3; ++j)
+		for (size_t k = 0; k < 3; ++k)
+		{
+			s[j][k] += a[i][j] * b[i][k];
+		}
+		double n[4][4] =
+		{
+			{ s[0][0] + s[1][1] + s[2][2], s[1][2] - s[2][1], s[2][0] - s[0][2], s[0][1] - s[1][0] },
+			{ s[1][2] - s[2][1], s[0][0] - s[1][1] - s[2][2], s[0][1] + s[1][0], s[2][0] + s[0][2] },
+			{ s[2][0] - s[0][2], s[0][1] + s[1][0], s[1][1] - s[0][0] - s[2][2], s[1][2] + s[2][1] },
+			{ s[0][1] - s[1][0], s[2][0] + s[0][2], s[1][2] + s[2][1], s[2][2] - s[0][0] - s[1][1] },
+		};
+		double v[4][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } };
+		for (size_t sweep = 0; sweep < 50; ++sweep)
+		{
+			double off = 0;
+			for (size_t p = 0; p < 3; ++p)
+			for (size_t q = p + 1; q < 4; ++q)
+			{
+				off += fabs(n[p][q]);
+			}
+			if (off < 1e-12) break;
+			for (size_t p = 0; p < 3; ++p)
+			for (size_t q = p + 1; q < 4; ++q)
+			{
+				if (fabs(n[p][q]) < 1e-15) continue;
+				const double theta = (n[q][q] - n[p][p]) / (2 * n[p][q]);
+				const double t = (theta < 0 ? -1 : 1) / (fabs(theta) + sqrt(theta * theta + 1));
+				const double c = 1 / sqrt(t * t + 1);
+				const double sn = t * c;
+				for (size_t k = 0; k < 4; ++k)
+				{
+					const double kp = n[k][p], kq = n[k][q];
+					n[k][p] = c * kp - sn * kq;
+					n[k][q] = sn * kp + c * kq;
+				}
+				for (size_t k = 0; k < 4; ++k)
+				{
+					const double pk = n[p][k], qk = n[q][k];
+					n[p][k] = c * pk - sn * qk;
+					n[q][k] = sn * pk + c * qk;
+				}
+				for (size_t k = 0; k < 4; ++k)
+				{
+					const double kp = v[k][p], kq = v[k][q];
+					v[k][p] = c * kp - sn * kq;
+					v[k][q] = sn * kp + c * kq;
+				}
+			}
+		}
+		size_t m = 0;
+		for (size_t i = 1; i < 4; ++i)
+		{
+			if (n[i][i] > n[m][m]) m = i;
+		}
+		return normalize(array<float, 4>{{ static_cast<float>(v[0][m]), static_cast<float>(v[1][m]), static_cast<float>(v[2][m]), static_cast<float>(v[3][m]) }});
+	}
+}
+
+pose_library::pose_library(const size_t num_poses) : num_poses(num_poses)
+{
+}
+
+vector<size_t> pose_library::root_xs(const ligand& lig)
+{
+	vector<size_t> xs;
+	const frame& root = lig.frames.front();
+	for (size_t i = root.rotorYidx; i < root.childYidx; ++i)
+	{
+		xs.push_back(lig.atoms[i].xs);
+	}
+	return xs;
+}
+
+void pose_library::add(const ligand& lig, const float* const ex, const size_t num_tasks)
+{
+	vector<size_t> xs = root_xs(lig);
+	if (xs.size() < 3) return;
+
+	// Rank the tasks by free energy, and keep the ROOT poses of the best ones.
+	vector<size_t> rank(num_tasks);
+	iota(rank.begin(), rank.end(), 0);
+	sort(rank.begin(), rank.end(), [ex](const size_t v0, const size_t v1)
+	{
+		return ex[v0] < ex[v1];
+	});
+	entry& e = entries[xs];
+	e.xs = move(xs);
+	e.coords.clear();
+	for (size_t i = 0; i < e.xs.size(); ++i)
+	{
+		e.coords.push_back(lig.atoms[i].coord);
+	}
+	e.poses.resize(min(num_poses, num_tasks));
+	for (size_t i = 0; i < e.poses.size(); ++i)
+	{
+		for (size_t k = 0; k < 7; ++k)
+		{
+			e.poses[i][k] = ex[num_tasks * (1 + k) + rank[i]];
+		}
+	}
+}
+
+vector<array<float, 7>> pose_library::align(const ligand& lig) const
+{
+	vector<array<float, 7>> poses;
+	const auto it = entries.find(root_xs(lig));
+	if (it == entries.cend()) return poses;
+	const entry& e = it->second;
+
+	// Center the ROOT heavy atoms of lig and of the library ligand.
+	const size_t n = e.coords.size();
+	vector<array<double, 3>> a(n), b(n);
+	array<double, 3> ca = {}, cb = {};
+	for (size_t i = 0; i < n; ++i)
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			ca[k] += (a[i][k] = lig.atoms[i].coord[k]) / n;
+			cb[k] += (b[i][k] = e.coords[i][k]) / n;
+		}
+	}
+	for (size_t i = 0; i < n; ++i)
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			a[i][k] -= ca[k];
+			b[i][k] -= cb[k];
+		}
+	}
+
+	// Superimpose the ROOT frame of lig onto that of the library ligand, and refuse ROOT frames of different geometries.
+	const array<float, 4> q = superimpose(a, b);
+	const array<float, 9> r = qtn4_to_mat3(q);
+	float se = 0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		const array<float, 3> ai = {{ static_cast<float>(a[i][0]), static_cast<float>(a[i][1]), static_cast<float>(a[i][2]) }};
+		const array<float, 3> bi = {{ static_cast<float>(b[i][0]), static_cast<float>(b[i][1]), static_cast<float>(b[i][2]) }};
+		se += distance_sqr(r * ai, bi);
+	}
+	if (se > 0.25f * n) return poses;
+
+	// Compose every library pose with the superimposition. The ROOT origin of lig, i.e. its first atom, lands at the library pose position plus the rotated translation of the superimposition.
+	const array<float, 3> cat = {{ static_cast<float>(ca[0]), static_cast<float>(ca[1]), static_cast<float>(ca[2]) }};
+	const array<float, 3> cbt = {{ static_cast<float>(cb[0]), static_cast<float>(cb[1]), static_cast<float>(cb[2]) }};
+	const array<float, 3> t = cbt - r * cat;
+	for (const auto& p : e.poses)
+	{
+		const array<float, 4> pq = normalize(array<float, 4>{{ p[3], p[4], p[5], p[6] }});
+		const array<float, 3> o = array<float, 3>{{ p[0], p[1], p[2] }} + qtn4_to_mat3(pq) * t;
+		const array<float, 4> oq = normalize(pq * q);
+		poses.push_back({{ o[0], o[1], o[2], oq[0], oq[1], oq[2], oq[3] }});
+	}
+	return poses;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#ifndef IDOCK_WARM_START_HPP
+#define IDOCK_WARM_START_HPP
+
+#include <map>
+#include "ligand.hpp"
+
+//! Represents a library of the ROOT poses of the best conformations of docked ligands, keyed by the XScore atom types of their ROOT frames, from which the Monte Carlo tasks of analogs sharing a rigid scaffold are warm started.
+class pose_library
+{
+public:
+	//! Constructs an empty library keeping the ROOT poses of the best num_poses tasks of every ligand.
+	explicit pose_library(const size_t num_poses);
+
+	//! Adds the ROOT poses of the best tasks of a docked ligand, whose conformations ex of num_tasks tasks are laid out as in ligand::cluster(), replacing those of the previous ligand of the same ROOT atom types. Ligands of fewer than 3 ROOT heavy atoms are ignored.
+	void add(const ligand& lig, const float* const ex, const size_t num_tasks);
+
+	//! Returns the ROOT poses, i.e. position and orientation quaternion, of the library ligand of the same ROOT atom types as lig, transformed so that the ROOT heavy atoms of lig superimpose onto those of the library ligand, or nothing if there is no such ligand or their ROOT frames differ by more than 0.5 Angstrom RMSD.
+	vector<array<float, 7>> align(const ligand& lig) const;
+private:
+	//! Represents the ROOT frame of a docked ligand and the ROOT poses of its best tasks.
+	class entry
+	{
+	public:
+		vector<size_t> xs; //!< XScore atom types of the ROOT heavy atoms.
+		vector<array<float, 3>> coords; //!< Coordinates of the ROOT heavy atoms relative to the ROOT origin.
+		vector<array<float, 7>> poses; //!< ROOT poses of the best tasks in ascending order of free energy.
+	};
+
+	//! Returns the XScore atom types of the ROOT heavy atoms of a ligand.
+	static vector<size_t> root_xs(const ligand& lig);
+
+	const size_t num_poses;
+	map<vector<size_t>, entry> entries; //!< Entries keyed by the XScore atom types of their ROOT heavy atoms.
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include <cmath>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <thread>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <map>
+#include "../src/rmsd.hpp"
+#include "../src/box.hpp"
+using namespace std;
+using namespace boost::filesystem;
+
+//! Represents an example, i.e. a folder containing an idock.conf. If its input folder holds a single ligand that lies in the search space, the ligand is taken as a crystal ligand for redocking.
+class example
+{
+public:
+	path folder; //!< Folder of idock.conf.
+	path crystal; //!< Crystal ligand, or empty for a screening example.
+};
+
+//! Represents one point of the grid of settings.
+class setting
+{
+public:
+	size_t tasks;
+	size_t generations;
+	string granularity;
+	size_t threads;
+};
+
+//! Splits a comma separated list.
+template <typename T>
+vector<T> split(const string& s, T (*convert)(const string&))
+{
+	vector<T> v;
+	for (size_t b = 0, e; b <= s.size(); b = e + 1)
+	{
+		e = s.find(',', b);
+		if (e == string::npos) e = s.size();
+		v.push_back(convert(s.substr(b, e - b)));
+	}
+	return v;
+}
+
+size_t to_size(const string& s) { return stoul(s); }
+string to_str(const string& s) { return s; }
+
+//! Returns the key=value pairs of an idock.conf.
+map<string, string> parse_conf(const path& conf)
+{
+	map<string, string> options;
+	boost::filesystem::ifstream ifs(conf);
+	for (string line; getline(ifs, line);)
+	{
+		line.erase(remove_if(line.begin(), line.end(), ::isspace), line.end());
+		const size_t eq = line.find('=');
+		if (eq != string::npos) options[line.substr(0, eq)] = line.substr(eq + 1);
+	}
+	return options;
+}
+
+//! Returns true if the center of the heavy atoms of a ligand lies in the search space of an idock.conf. Some bundled ligands are not in their crystal poses but centered at the origin.
+bool in_search_space(const path& ligand, const map<string, string>& options)
+{
+	boost::filesystem::ifstream ifs(ligand);
+	const box b(ifs, vector<string>(), 0);
+	if (!b.num_atoms) return false;
+	const array<char, 3> c = {{ 'x', 'y', 'z' }};
+	for (size_t i = 0; i < 3; ++i)
+	{
+		const auto center = options.find(string("center_") + c[i]), size = options.find(string("size_") + c[i]);
+		if (center == options.cend() || size == options.cend()) return false;
+		if (fabs(b.center[i] - stof(center->second)) > 0.5f * stof(size->second)) return false;
+	}
+	return true;
+}
+
+//! Returns the symmetry corrected RMSD between the first pose of a docked file and a crystal ligand, or -1 if their heavy atoms do not match.
+float top_rmsd(const path& crystal_path, const path& docked_path)
+{
+	boost::filesystem::ifstream cs(crystal_path), ds(docked_path);
+	const rmsd_molecule crystal(cs), docked(ds);
+	if (crystal.poses.empty() || docked.poses.empty() || crystal.na != docked.na) return -1;
+	vector<vector<size_t>> mappings = isomorphisms(crystal, docked);
+	if (mappings.empty())
+	{
+		mappings.emplace_back(crystal.na);
+		iota(mappings.back().begin(), mappings.back().end(), 0);
+	}
+	vector<vector<float>> permuted(mappings.size(), vector<float>(3 * crystal.stride));
+	for (size_t k = 0; k < mappings.size(); ++k)
+	{
+		permute(crystal.poses.front().data(), mappings[k], crystal.stride, permuted[k].data());
+	}
+	return rmsd(permuted, docked.poses.front().data(), docked.stride, docked.na);
+}
+
+int main(int argc, char* argv[])
+{
+	// Parse flags. The default grid is a single point of the default settings of idock.
+	vector<size_t> tasks = { 256 }, generations = { 300 }, threads = { max<size_t>(thread::hardware_concurrency(), 1) };
+	vector<string> granularities = { "0.15625" };
+	path work_folder = "benchmark";
+	path runs_path;
+	size_t seed = 1;
+	bool crystal_only = false;
+	vector<string> positional;
+	for (int i = 1; i < argc; ++i)
+	{
+		const string a = argv[i];
+		if (a == "-t" && i + 1 < argc) tasks = split(argv[++i], to_size);
+		else if (a == "-g" && i + 1 < argc) generations = split(argv[++i], to_size);
+		else if (a == "-r" && i + 1 < argc) granularities = split(argv[++i], to_str);
+		else if (a == "-j" && i + 1 < argc) threads = split(argv[++i], to_size);
+		else if (a == "-s" && i + 1 < argc) seed = stoul(argv[++i]);
+		else if (a == "-w" && i + 1 < argc) work_folder = argv[++i];
+		else if (a == "-o" && i + 1 < argc) runs_path = argv[++i];
+		else if (a == "-c") crystal_only = true;
+		else if (a == "-h")
+		{
+			cout << "benchmark [-t tasks,...] [-g generations,...] [-r granularity,...] [-j threads,...] [-s seed] [-w work_folder] [-o runs.csv] [-c] idock_cp examples_folder\n";
+			return 0;
+		}
+		else positional.push_back(a);
+	}
+	if (positional.size() != 2)
+	{
+		cerr << "benchmark [-t tasks,...] [-g generations,...] [-r granularity,...] [-j threads,...] [-s seed] [-w work_folder] [-o runs.csv] [-c] idock_cp examples_folder\n";
+		return 1;
+	}
+	const path idock = canonical(positional[0]);
+	const path examples_folder = positional[1];
+
+	// Collect the examples, sorted for a stable order.
+	vector<example> examples;
+	for (recursive_directory_iterator it(examples_folder), end; it != end; ++it)
+	{
+		if (it->path().filename() != "idock.conf") continue;
+		example e;
+		e.folder = it->path().parent_path();
+		const map<string, string> options = parse_conf(it->path());
+		const auto input_option = options.find("input_folder");
+		const path input = input_option == options.cend() ? path() : path(input_option->second).is_absolute() ? path(input_option->second) : e.folder / input_option->second;
+		vector<path> ligands;
+		if (is_directory(input))
+		{
+			for (directory_iterator lt(input), lend; lt != lend; ++lt)
+			{
+				if (lt->path().extension() == ".pdbqt") ligands.push_back(lt->path());
+			}
+		}
+		if (ligands.size() == 1 && in_search_space(ligands.front(), options)) e.crystal = ligands.front();
+		if (crystal_only && e.crystal.empty()) continue;
+		examples.push_back(move(e));
+	}
+	sort(examples.begin(), examples.end(), [](const example& a, const example& b)
+	{
+		return a.folder < b.folder;
+	});
+
+	// Expand the grid of settings.
+	vector<setting> settings;
+	for (const size_t t : tasks)
+	for (const size_t g : generations)
+	for (const string& r : granularities)
+	for (const size_t j : threads)
+	{
+		settings.push_back({ t, g, r, j });
+	}
+
+	create_directories(work_folder);
+	const path work = canonical(work_folder);
+	boost::filesystem::ofstream runs;
+	if (!runs_path.empty())
+	{
+		runs.open(runs_path);
+		runs.setf(ios::fixed, ios::floatfield);
+		runs << setprecision(3) << "Example,Tasks,Generations,Granularity,Threads,Wall,Ligands,LigandsPerSecond,TopRMSD\n";
+	}
+	cout.setf(ios::fixed, ios::floatfield);
+	cout << "Tasks,Generations,Granularity,Threads,Wall,Ligands,LigandsPerSecond,Redockings,MeanTopRMSD,Success2A\n";
+	for (size_t s = 0; s < settings.size(); ++s)
+	{
+		const setting& st = settings[s];
+		double wall = 0, sum_rmsd = 0;
+		size_t ligands = 0, redockings = 0, successes = 0;
+		for (size_t i = 0; i < examples.size(); ++i)
+		{
+			const example& e = examples[i];
+			const string name = e.folder.parent_path().filename().string() + '/' + e.folder.filename().string();
+			const path out = work / to_string(s) / to_string(i);
+			remove_all(out);
+			create_directories(out);
+
+			// Run idock in the example folder so that the relative paths of idock.conf resolve. Command line options take precedence over the conf.
+			ostringstream cmd;
+			cmd << "cd \"" << e.folder.string() << "\" && \"" << idock.string() << "\" --config idock.conf"
+			    << " --output_folder \"" << (out / "output").string() << "\" --log \"" << (out / "log.csv").string() << '"'
+			    << " --tasks " << st.tasks << " --generations " << st.generations << " --granularity " << st.granularity << " --threads " << st.threads << " --seed " << seed
+			    << " > \"" << (out / "stdout.txt").string() << "\" 2>&1";
+			const auto t0 = chrono::steady_clock::now();
+			const int status = system(cmd.str().c_str());
+			const double w = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+			if (status)
+			{
+				cerr << "idock failed on " << name << ", see " << out / "stdout.txt" << endl;
+				continue;
+			}
+
+			// Count the ligands in the log, and compute the top pose RMSD of a redocking example.
+			size_t n = 0;
+			boost::filesystem::ifstream log(out / "log.csv");
+			for (string line; getline(log, line); ++n);
+			if (n) --n;
+			float r = -1;
+			if (!e.crystal.empty())
+			{
+				const path docked = out / "output" / e.crystal.filename();
+				if (exists(docked)) r = top_rmsd(e.crystal, docked);
+				if (r < 0) cerr << "Cannot compute the RMSD of " << docked << " to " << e.crystal << endl;
+			}
+			wall += w;
+			ligands += n;
+			if (r >= 0)
+			{
+				++redockings;
+				sum_rmsd += r;
+				if (r < 2) ++successes;
+			}
+			if (runs.is_open())
+			{
+				runs << name << ',' << st.tasks << ',' << st.generations << ',' << st.granularity << ',' << st.threads << ',' << w << ',' << n << ',' << n / w << ',';
+				if (r >= 0) runs << r;
+				runs << '\n';
+			}
+		}
+		cout << st.tasks << ',' << st.generations << ',' << st.granularity << ',' << st.threads << ',' << setprecision(3) << wall << ',' << ligands << ',' << (wall > 0 ? ligands / wall : 0) << ',' << redockings << ',';
+		if (redockings) cout << sum_rmsd / redockings << ',' << setprecision(1) << 100.0 * successes / redockings << '%';
+		else cout << ',';
+		cout << endl;
+	}
+}
@@ -2,6 +2,14 @@
 #include <iomanip>
 #include <string>
 #include <vector>
+#include <queue>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -9,6 +17,14 @@
 
 using std::string;
 using std::vector;
+using std::pair;
+using std::priority_queue;
+using std::thread;
+using std::future;
+using std::atomic;
+using std::mutex;
+using std::lock_guard;
+using std::function;
 using boost::lexical_cast;
 using boost::filesystem::path;
 using boost::filesystem::directory_iterator;
@@ -16,27 +32,6 @@ using boost::filesystem::is_directory;
 using boost::filesystem::ifstream;
 using boost::filesystem::ofstream;
 
-class record
-{
-public:
-	string line;
-	string slice;
-	size_t comma;
-	double energy;
-
-	explicit record(string&& line_, const string& slice) : line(static_cast<string&&>(line_)), slice(slice), comma(line.find_first_of(',', 12)), energy(lexical_cast<double>(line.substr(comma + 3, line.find_first_of(',', comma + 8) - comma - 3))) {}
-
-	record(const record&) = default;
-	record(record&&) = default;
-	record& operator=(const record&) = default;
-	record& operator=(record&&) = default;
-};
-
-inline bool operator<(const record& a, const record& b)
-{
-	return a.energy < b.energy;
-}
-
 inline bool starts_with(const string& str, const string& start)
 {
 	const size_t start_size = start.size();
@@ -48,39 +43,104 @@ inline bool starts_with(const string& str, const string& start)
 	return true;
 }
 
-class property
+// A combined record is a line of the output csv, i.e. Slice,Ligand,Conf,FE1,HB1,... The two sort keys are extracted from it on demand so that runs on disk are plain csv lines.
+
+// Returns the ligand id, i.e. the 2nd field of a combined record.
+inline string id_of(const string& line)
 {
-public:
-	string line;
-	string id;
+	const size_t s = line.find(',') + 1;
+	return line.substr(s, line.find(',', s) - s);
+}
 
-	explicit property(string&& line_) : line(static_cast<string&&>(line_)), id(line.substr(4, 8)) {}
-};
+// Returns the free energy of the first conformation, i.e. the 4th field of a combined record.
+inline double energy_of(const string& line)
+{
+	size_t s = line.find(',') + 1;
+	s = line.find(',', s) + 1;
+	s = line.find(',', s) + 1;
+	return strtod(line.c_str() + s, nullptr);
+}
 
-inline size_t binary(const vector<property>& properties, const string& id)
+// Sorts an unbounded number of lines with bounded memory by spilling sorted runs to disk and k-way merging them.
+template <typename Key>
+class external_sorter
 {
-	size_t s = 0;
-	size_t e = properties.size();
-	while (s + 1 < e)
+public:
+	explicit external_sorter(const path& dir, const string& name, const function<Key(const string&)>& key) : dir(dir), name(name), key(key) {}
+
+	// Sorts a chunk of lines and writes it to a new run file. Thread safe.
+	void spill(vector<string>& lines)
 	{
-		const size_t mid = (s + e) / 2;
-		if (id < properties[mid].id)
+		if (lines.empty()) return;
+		vector<pair<Key, size_t>> keys;
+		keys.reserve(lines.size());
+		for (size_t i = 0; i < lines.size(); ++i)
 		{
-			e = mid;
+			keys.emplace_back(key(lines[i]), i);
 		}
-		else
+		std::stable_sort(keys.begin(), keys.end(), [](const pair<Key, size_t>& a, const pair<Key, size_t>& b)
+		{
+			return a.first < b.first;
+		});
+		path run;
 		{
-			s = mid;
+			lock_guard<mutex> guard(m);
+			run = dir / (name + lexical_cast<string>(runs.size()));
+			runs.push_back(run);
 		}
+		ofstream out(run);
+		for (const auto& k : keys)
+		{
+			out << lines[k.second] << '\n';
+		}
+		lines.clear();
 	}
-	return s;
-}
+
+	// Merges all the runs in ascending order of key, passing each line to sink, and removes the run files.
+	void merge(const function<void(const string&)>& sink)
+	{
+		const size_t num_runs = runs.size();
+		vector<ifstream> ins(num_runs);
+		vector<string> heads(num_runs);
+		typedef pair<Key, size_t> entry;
+		priority_queue<entry, vector<entry>, std::greater<entry>> q;
+		for (size_t i = 0; i < num_runs; ++i)
+		{
+			ins[i].open(runs[i]);
+			if (getline(ins[i], heads[i])) q.emplace(key(heads[i]), i);
+		}
+		while (!q.empty())
+		{
+			const size_t i = q.top().second;
+			q.pop();
+			sink(heads[i]);
+			if (getline(ins[i], heads[i])) q.emplace(key(heads[i]), i);
+		}
+		for (size_t i = 0; i < num_runs; ++i)
+		{
+			ins[i].close();
+			remove(runs[i]);
+		}
+		runs.clear();
+	}
+
+	size_t num_runs() const
+	{
+		return runs.size();
+	}
+private:
+	const path dir;
+	const string name;
+	const function<Key(const string&)> key;
+	vector<path> runs;
+	mutex m;
+};
 
 int main(int argc, char* argv[])
 {
-	if (argc != 5)
+	if (argc < 5 || argc > 7)
 	{
-		std::cout << "combinelog slices_folder prefix 16_prop_350.xls out.csv\n";
+		std::cout << "combinelog slices_folder prefix 16_prop_350.xls out.csv [num_threads] [max_records_in_memory]\n";
 		return 1;
 	}
 
@@ -88,73 +148,122 @@ int main(int argc, char* argv[])
 	const string prefix = argv[2];
 	const path prop = argv[3];
 	const path output_csv = argv[4];
+	const size_t num_threads = argc > 5 ? lexical_cast<size_t>(argv[5]) : std::max<size_t>(thread::hardware_concurrency(), 1);
+	const size_t max_records = argc > 6 ? lexical_cast<size_t>(argv[6]) : 1000000;
+	const size_t max_records_per_thread = std::max<size_t>(max_records / num_threads, 1);
 
-	string line;
-	line.reserve(600);
+	// Runs are spilled next to the output csv.
+	const path tmp = absolute(output_csv).parent_path() / boost::filesystem::unique_path("combinelog-%%%%-%%%%");
+	create_directories(tmp);
 
-	std::cout << "Reading log.csv's." << std::endl;
-	vector<record> records;
-	records.reserve(80000);
+	vector<path> slice_paths;
 	const directory_iterator end_dir_iter;
 	for (directory_iterator dir_iter(slices); dir_iter != end_dir_iter; ++dir_iter)
 	{
 		if (!is_directory(dir_iter->status())) continue; // Find example directories.
 		const path slice_path = dir_iter->path();
-		const string fullslice = slice_path.filename().string();
-		if (!starts_with(fullslice, prefix)) continue;
-		std::cout << fullslice << '\n';
-		const string slice = fullslice.substr(6);
-		ifstream log(slice_path / "log.csv");
-		getline(log, line); // Filter out header line.
-		while (getline(log, line))
-		{
-			records.push_back(record(static_cast<string&&>(line), slice));
-		}
+		if (!starts_with(slice_path.filename().string(), prefix)) continue;
+		slice_paths.push_back(slice_path);
 	}
 
-	const size_t num_records = records.size();
-	std::cout << "Sorting " << num_records << " records." << std::endl;
-	std::sort(records.begin(), records.end());
-
-	std::cout << "Reading property xls file " << prop << '.' << std::endl;
-	vector<property> properties;
-	properties.reserve(7220928); // Number of molecules in 16_prop_350.xls
-	ifstream xls(prop);
-	getline(xls, line); // Filter out header line.
-	while (getline(xls, line))
+	// Parse log.csv's in parallel, and spill runs sorted by ligand id.
+	std::cout << "Reading " << slice_paths.size() << " log.csv's with " << num_threads << " threads." << std::endl;
+	external_sorter<string> by_id(tmp, "id", id_of);
+	atomic<size_t> next_slice(0), num_records(0);
+	vector<thread> workers;
+	for (size_t t = 0; t < num_threads; ++t)
 	{
-		properties.push_back(property(static_cast<string&&>(line)));
+		workers.emplace_back([&]()
+		{
+			vector<string> lines;
+			lines.reserve(std::min<size_t>(max_records_per_thread, 100000));
+			string line;
+			line.reserve(600);
+			for (size_t i; (i = next_slice++) < slice_paths.size();)
+			{
+				const string slice = slice_paths[i].filename().string().substr(6);
+				ifstream log(slice_paths[i] / "log.csv");
+				getline(log, line); // Filter out header line.
+				while (getline(log, line))
+				{
+					const size_t comma = line.find_first_of(',', 12);
+					lines.push_back(slice + ',' + line.substr(4, 8) + ',' + line.substr(comma + 1));
+					if (lines.size() == max_records_per_thread) by_id.spill(lines);
+					++num_records;
+				}
+			}
+			by_id.spill(lines);
+		});
 	}
-	xls.close();
-	std::cout << properties.size() << " records in prop xls file." << std::endl;
+	for (auto& w : workers) w.join();
 
-	std::cout << "Writing combined csv to " << output_csv << std::endl;
-	ofstream csv(output_csv);
-	csv << "Slice,Ligand,Conf,FE1,HB1,FE2,HB2,FE3,HB3,FE4,HB4,FE5,HB5,FE6,HB6,FE7,HB7,FE8,HB8,FE9,HB9,HA,MWT,LogP,Desolv_apolar,Desolv_polar,HBD,HBA,tPSA,Charge,NRB,SMILES\n";
-	size_t s, e, num_not_found = 0;
-	for (size_t i = 0; i < num_records; ++i)
+	// Merge the runs by ligand id and join them with the property file, which is sorted by ligand id. Spill the joined records in runs sorted by energy.
+	std::cout << "Joining " << num_records << " records in " << by_id.num_runs() << " runs with property xls file " << prop << '.' << std::endl;
+	external_sorter<double> by_energy(tmp, "energy", energy_of);
+	vector<string> joined, sorting;
+	joined.reserve(std::min<size_t>(max_records, 100000));
+	future<void> pending;
+	const auto spill_async = [&]()
 	{
-		const record& r = records[i];
-		const string id = r.line.substr(4, 8);
-		csv << r.slice << ',' << id << ',' << r.line.substr(r.comma + 1);
-		const property& p = properties[binary(properties, id)];
-		if (id != p.id)
+		if (pending.valid()) pending.get();
+		sorting.swap(joined);
+		pending = std::async(std::launch::async, [&]()
+		{
+			by_energy.spill(sorting);
+		});
+	};
+	ifstream xls(prop);
+	string line, prop_line, prop_id;
+	getline(xls, line); // Filter out header line.
+	bool prop_valid = false;
+	size_t num_not_found = 0;
+	by_id.merge([&](const string& r)
+	{
+		const string id = id_of(r);
+		while (!prop_valid || prop_id < id)
+		{
+			if (!getline(xls, prop_line))
+			{
+				prop_id = "\x7f";
+				prop_valid = true;
+				break;
+			}
+			prop_id = prop_line.substr(4, 8);
+			prop_valid = true;
+		}
+		string out = r;
+		if (id != prop_id)
 		{
-			//std::cerr << id << ' '  << p.id;
 			++num_not_found;
-			csv << ",,,,,,,,,,,,,,,,,,,\n";
-			continue;
+			out += ",,,,,,,,,,,,,,,,,,,";
 		}
-		s = 13;
-		for (size_t j = 0; j < 10; ++j) // 9 properties, i.e. HA,MWT,LogP,Desolv_apolar,Desolv_polar,HBD,HBA,tPSA,Charge,NRB
+		else
 		{
-			e = p.line.find_first_of('\t', s + 1);
-			csv << ',' << p.line.substr(s, e - s);
-			s = e + 1;
+			size_t s = 13, e;
+			for (size_t j = 0; j < 10; ++j) // 9 properties, i.e. HA,MWT,LogP,Desolv_apolar,Desolv_polar,HBD,HBA,tPSA,Charge,NRB
+			{
+				e = prop_line.find_first_of('\t', s + 1);
+				out += ',' + prop_line.substr(s, e - s);
+				s = e + 1;
+			}
+			out += ',' + prop_line.substr(s); // SMILES
 		}
-		csv << ',' << p.line.substr(s) << '\n'; // SMILES
-	}
+		joined.push_back(std::move(out));
+		if (joined.size() == max_records) spill_async();
+	});
+	spill_async();
+	pending.get();
+	xls.close();
+
+	std::cout << "Writing combined csv to " << output_csv << " by merging " << by_energy.num_runs() << " runs." << std::endl;
+	ofstream csv(output_csv);
+	csv << "Slice,Ligand,Conf,FE1,HB1,FE2,HB2,FE3,HB3,FE4,HB4,FE5,HB5,FE6,HB6,FE7,HB7,FE8,HB8,FE9,HB9,HA,MWT,LogP,Desolv_apolar,Desolv_polar,HBD,HBA,tPSA,Charge,NRB,SMILES\n";
+	by_energy.merge([&](const string& r)
+	{
+		csv << r << '\n';
+	});
 	csv.close();
+	remove_all(tmp);
 	std::cout << num_not_found << " records in log.csv's but not in prop xls file." << std::endl;
 
 	return 0;
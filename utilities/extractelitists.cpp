@@ -1,41 +1,182 @@
 #include <iostream>
+#include <iomanip>
 #include <string>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <algorithm>
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/operations.hpp>
 
 using std::string;
+using std::vector;
+using std::priority_queue;
+using std::thread;
+using std::atomic;
 using boost::lexical_cast;
 using boost::filesystem::path;
 using boost::filesystem::ifstream;
+using boost::filesystem::directory_iterator;
+
+class elitist
+{
+public:
+	double energy;
+	path pose;
+};
+
+// Orders elitists by energy so that the top of a priority_queue is the worst one kept.
+inline bool operator<(const elitist& a, const elitist& b)
+{
+	return a.energy < b.energy;
+}
+
+// Returns the index of a column in a csv header, or npos if absent.
+inline size_t column(const vector<string>& header, const string& name)
+{
+	return find(header.cbegin(), header.cend(), name) - header.cbegin();
+}
+
+// Splits a csv line into fields.
+inline void split(const string& line, vector<string>& fields)
+{
+	fields.clear();
+	for (size_t s = 0, e; s <= line.size(); s = e + 1)
+	{
+		e = line.find(',', s);
+		if (e == string::npos) e = line.size();
+		fields.push_back(line.substr(s, e - s));
+	}
+}
+
+// Scans a log in one pass, keeping its best num_elitists records in a bounded max heap.
+// A combined log with a Slice column, as written by combinelog, refers to poses in examples/16_p0.<slice>/output.
+// A per-slice log, as written by idock, refers to poses in the output folder next to it.
+void scan(const path& log_path, const path& examples, const size_t num_elitists, priority_queue<elitist>& heap)
+{
+	const string output = "output";
+	const string pdbqtext = ".pdbqt";
+	ifstream log(log_path);
+	string line;
+	line.reserve(600);
+	vector<string> header, fields;
+	if (!getline(log, line)) return;
+	split(line, header);
+	const size_t slice_col = column(header, "Slice");
+	const size_t ligand_col = column(header, "Ligand");
+	size_t energy_col = column(header, "FE1");
+	if (energy_col == header.size()) energy_col = column(header, "pKd1");
+	if (ligand_col == header.size() || energy_col == header.size())
+	{
+		std::cerr << "Skipping " << log_path << " without Ligand and FE1 or pKd1 columns\n";
+		return;
+	}
+	while (getline(log, line))
+	{
+		split(line, fields);
+		if (fields.size() <= std::max(ligand_col, energy_col)) continue;
+		const double energy = strtod(fields[energy_col].c_str(), nullptr);
+		if (heap.size() == num_elitists && !(energy < heap.top().energy)) continue;
+		const string& id = fields[ligand_col];
+		const string ligand = (id.find_first_not_of("0123456789") == string::npos ? "ZINC" + id : id) + pdbqtext;
+		const path folder = slice_col < fields.size() ? examples / ("16_p0." + fields[slice_col]) : log_path.parent_path();
+		heap.push({ energy, folder / output / ligand });
+		if (heap.size() > num_elitists) heap.pop();
+	}
+}
 
 int main(int argc, char* argv[])
 {
-	if (argc != 3)
+	if (argc != 3 && argc != 4)
 	{
-		std::cout << "extractelitists examples_folder num_elitists\n";
+		std::cout << "extractelitists examples_folder num_elitists [num_threads]\n";
 		return 1;
 	}
 
 	const path examples = argv[1];
 	const size_t num_elitists = lexical_cast<size_t>(argv[2]);
+	const size_t num_threads = argc == 4 ? lexical_cast<size_t>(argv[3]) : std::max<size_t>(thread::hardware_concurrency(), 1);
+	if (!num_threads)
+	{
+		std::cerr << "num_threads must be positive\n";
+		return 1;
+	}
+	if (!num_elitists) return 0;
 
-	const string output = "output";
-	const string pdbqtext = ".pdbqt";
-	string line;
-	line.reserve(600);
+	// Collect the combined log of the examples folder if any, or else the per-slice logs of its subfolders, as the combined log holds the records of the per-slice logs.
+	vector<path> logs;
+	if (exists(examples / "log.csv"))
+	{
+		logs.push_back(examples / "log.csv");
+	}
+	else
+	{
+		const directory_iterator end_dir_iter;
+		for (directory_iterator dir_iter(examples); dir_iter != end_dir_iter; ++dir_iter)
+		{
+			const path log_path = dir_iter->path() / "log.csv";
+			if (is_directory(dir_iter->status()) && exists(log_path)) logs.push_back(log_path);
+		}
+	}
+
+	// Select the global top elitists with one bounded heap per thread, then merge the heaps.
+	vector<priority_queue<elitist>> heaps(num_threads);
+	atomic<size_t> next(0);
+	vector<thread> workers;
+	for (size_t t = 0; t < num_threads; ++t)
+	{
+		workers.emplace_back([&, t]()
+		{
+			for (size_t i; (i = next++) < logs.size();)
+			{
+				scan(logs[i], examples, num_elitists, heaps[t]);
+			}
+		});
+	}
+	for (auto& w : workers) w.join();
+	priority_queue<elitist>& heap = heaps.front();
+	for (size_t t = 1; t < num_threads; ++t)
+	{
+		for (; !heaps[t].empty(); heaps[t].pop())
+		{
+			heap.push(heaps[t].top());
+			if (heap.size() > num_elitists) heap.pop();
+		}
+	}
+	vector<elitist> elitists(heap.size());
+	for (size_t i = elitists.size(); i; heap.pop())
+	{
+		elitists[--i] = heap.top();
+	}
+
+	// Copy the elite ligands to the current working directory in parallel.
+	next = 0;
+	workers.clear();
+	for (size_t t = 0; t < num_threads; ++t)
+	{
+		workers.emplace_back([&]()
+		{
+			for (size_t i; (i = next++) < elitists.size();)
+			{
+				const path ligand = elitists[i].pose.filename();
+				if (exists(ligand)) continue; // If this ligand has been extracted, no action is needed.
+				boost::system::error_code ec;
+				copy_file(elitists[i].pose, ligand, ec);
+				if (ec) std::cerr << "Failed to copy " << elitists[i].pose << ": " << ec.message() << '\n';
+			}
+		});
+	}
+	for (auto& w : workers) w.join();
 
-	ifstream log(examples / "log.csv");
-	getline(log, line); // Filter out header line.
-	for (size_t i = 0; i < num_elitists; ++i)
+	std::cout.setf(std::ios::fixed, std::ios::floatfield);
+	std::cout << "Rank,Energy,Pose\n" << std::setprecision(2);
+	for (size_t i = 0; i < elitists.size(); ++i)
 	{
-		getline(log, line);
-		const size_t comma = line.find_first_of(',', 1);
-		const path ligand = "ZINC" + line.substr(comma + 1, 8) + pdbqtext;
-		if (exists(ligand)) continue; // If this ligand has been extracted, no action is needed.
-		const string slice = "16_p0." + line.substr(0, comma);
-		copy(examples / slice / output / ligand, ligand); // Copy the elite ligand to the current working directory.
+		std::cout << i + 1 << ',' << elitists[i].energy << ',' << elitists[i].pose.string() << '\n';
 	}
 	return 0;
 }
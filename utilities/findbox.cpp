@@ -1,34 +1,79 @@
 #include <iostream>
 #include <iomanip>
-#include <limits>
-#include <algorithm>
+#include <fstream>
+#include <array>
+#include <vector>
+#include <string>
+#include "../src/box.hpp"
 using namespace std;
 
 int main(int argc, char* argv[])
 {
-	const size_t d = 3;
-	const array<size_t, d> p({ 30, 38, 46 });
-	const array<char, d> c({ 'x', 'y', 'z' });
-	vector<float> mn(d, numeric_limits<float>::max());
-	vector<float> mx(d, numeric_limits<float>::lowest());
-	for (string line; getline(cin, line);)
+	// Parse flags. The default seconds per probe per atom type is measured by populating the maps of 2IQH on a single thread.
+	float margin = 5;
+	float granularity = 0.15625f;
+	size_t num_types = 15;
+	size_t num_threads = 1;
+	double seconds_per_probe = 5.3e-7;
+	vector<string> residues;
+	string input;
+	for (int i = 1; i < argc; ++i)
 	{
-		if (line[0] != 'A' && line[0] != 'H') continue;
-		for (size_t i = 0; i < d; ++i)
+		const string a = argv[i];
+		if (a == "-m" && i + 1 < argc) margin = stof(argv[++i]);
+		else if (a == "-g" && i + 1 < argc) granularity = stof(argv[++i]);
+		else if (a == "-t" && i + 1 < argc) num_types = stoul(argv[++i]);
+		else if (a == "-j" && i + 1 < argc) num_threads = stoul(argv[++i]);
+		else if (a == "-s" && i + 1 < argc) seconds_per_probe = stod(argv[++i]);
+		else if (a == "-r" && i + 1 < argc)
 		{
-			const float v = stof(line.substr(p[i], 8));
-			mn[i] = min<float>(mn[i], v);
-			mx[i] = max<float>(mx[i], v);
+			// Residues are comma separated, e.g. A:123,A:145,201.
+			for (string r = argv[++i]; !r.empty();)
+			{
+				const size_t comma = r.find(',');
+				residues.push_back(r.substr(0, comma));
+				r = comma == string::npos ? string() : r.substr(comma + 1);
+			}
 		}
+		else if (a == "-h")
+		{
+			cout << "findbox [-m margin] [-g granularity] [-t atom_types] [-j threads] [-s seconds_per_probe] [-r A:123,A:145] [ligand_or_receptor.pdbqt] < ligand.pdbqt\n";
+			return 0;
+		}
+		else input = a;
 	}
+	if (!num_threads)
+	{
+		cerr << "The number of threads must be positive" << endl;
+		return 1;
+	}
+
+	ifstream ifs;
+	if (!input.empty()) ifs.open(input);
+	const box b(input.empty() ? cin : ifs, residues, margin);
+	if (!b.num_atoms)
+	{
+		cerr << "No heavy atoms found" << endl;
+		return 1;
+	}
+
 	cout.setf(ios::fixed, ios::floatfield);
 	cout << setprecision(3);
-	for (size_t i = 0; i < d; ++i)
+	const array<char, 3> c = {{ 'x', 'y', 'z' }};
+	for (size_t i = 0; i < 3; ++i)
 	{
-		cout << "center_" << c[i] << '=' << (mx[i] + mn[i]) * 0.5 << endl;
+		cout << "center_" << c[i] << '=' << b.center[i] << endl;
 	}
-	for (size_t i = 0; i < d; ++i)
+	for (size_t i = 0; i < 3; ++i)
 	{
-		cout << "size_"   << c[i] << '=' << (mx[i] - mn[i]) + 10 << endl;
+		cout << "size_"   << c[i] << '=' << b.size[i] << endl;
 	}
-}
\ No newline at end of file
+
+	// Report the grid map footprint and build time as comments so that the output remains a valid configuration file.
+	const array<int, 3> n = b.num_probes(granularity);
+	const size_t probes = static_cast<size_t>(n[0]) * n[1] * n[2];
+	cout << "# " << b.num_atoms << " heavy atoms enclosed with a margin of " << margin << " A" << endl
+	     << "# " << n[0] << " x " << n[1] << " x " << n[2] << " = " << probes << " probes at granularity " << granularity << endl
+	     << "# " << setprecision(1) << b.map_bytes(granularity) / 1048576.0 << " MB per map, " << b.map_bytes(granularity) * num_types / 1048576.0 << " MB for " << num_types << " atom types" << endl
+	     << "# " << probes * num_types * seconds_per_probe / num_threads << " s estimated to build the maps with " << num_threads << " threads" << endl;
+}
@@ -1,12 +1,17 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
-#include <fstream>
 #include <string>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <boost/lexical_cast.hpp>
-#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/operations.hpp>
 
 using namespace std;
@@ -15,75 +20,142 @@ using namespace boost::filesystem;
 
 typedef double fl;
 
-/// Returns true if a string starts with another string.
-inline bool starts_with(const string& str, const string& start)
+/// Returns true if the line [b, e) starts with a given string.
+inline bool starts_with(const char* b, const char* e, const char* start, const size_t start_size)
 {
-	const size_t start_size = start.size();
-	if (str.size() < start_size) return false;
-	for (size_t i = 0; i < start_size; ++i)
-	{
-		if (str[i] != start[i]) return false;
-	}
-	return true;
+	return static_cast<size_t>(e - b) >= start_size && !memcmp(b, start, start_size);
 }
 
-template<typename T>
-T right_cast(const string& str, const size_t i, const size_t j)
+/// Parses the right-justified number located in 1-based columns [i, j] of the line [b, e).
+inline fl right_cast(const char* b, const char* e, const size_t i, const size_t j)
 {
-	const size_t start = str.find_first_not_of(' ', i - 1);
-	return lexical_cast<T>(str.substr(start, j - start));
+	char buf[32] = {};
+	if (static_cast<size_t>(e - b) < i) return 0;
+	memcpy(buf, b + i - 1, min<size_t>(min<size_t>(j - i + 1, e - b - i + 1), sizeof(buf) - 1));
+	return strtod(buf, nullptr);
 }
 
 class summary
 {
 public:
-	const path filename;
-	const vector<fl> energies;
-	explicit summary(const path& filename, const vector<fl>& energies) : filename(filename), energies(energies) {}
+	path filename;
+	vector<fl> energies;
+	explicit summary(path&& filename, vector<fl>&& energies) : filename(move(filename)), energies(move(energies)) {}
 };
 
-/// For sorting ptr_vector<summary>.
+/// For sorting vector<summary>.
 inline bool operator<(const summary& a, const summary& b)
 {
 	return a.energies.front() < b.energies.front();
 }
 
+/// Collects the free energies from the REMARK lines of a docked file. The file is memory mapped and only lines starting with REMARK are parsed.
+vector<fl> scan(const path& p)
+{
+	static const char vina[] = "REMARK VINA RESULT:";
+	static const char idock[] = "REMARK       NORMALIZED FREE ENERGY PREDICTED BY IDOCK:";
+	vector<fl> energies;
+	energies.reserve(9);
+	const int fd = open(p.c_str(), O_RDONLY);
+	if (fd == -1) return energies;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size)
+	{
+		void* const m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m != MAP_FAILED)
+		{
+			madvise(m, st.st_size, MADV_SEQUENTIAL);
+			const char* const end = static_cast<const char*>(m) + st.st_size;
+			for (const char* b = static_cast<const char*>(m); b < end;)
+			{
+				const char* e = static_cast<const char*>(memchr(b, '\n', end - b));
+				if (!e) e = end;
+				if (*b == 'R')
+				{
+					if (starts_with(b, e, vina, sizeof(vina) - 1))
+					{
+						energies.push_back(right_cast(b, e, 20, 29));
+					}
+					else if (starts_with(b, e, idock, sizeof(idock) - 1))
+					{
+						energies.push_back(right_cast(b, e, 56, 63));
+					}
+				}
+				b = e + 1;
+			}
+			munmap(m, st.st_size);
+		}
+	}
+	close(fd);
+	return energies;
+}
+
 int main(int argc, char* argv[])
 {
-	if (argc != 2)
+	if (argc != 2 && argc != 3)
 	{
-		cout << "pdbqt2csv pdbqt_folder\n";
+		cout << "pdbqt2csv pdbqt_folder [num_threads]\n";
 		return 1;
 	}
+	const size_t num_threads = max<size_t>(argc == 3 ? lexical_cast<size_t>(argv[2]) : thread::hardware_concurrency(), 1);
 
-	ptr_vector<summary> summaries;
-	summaries.reserve(10000);
-	vector<fl> energies;
-	energies.reserve(9);
-	string line;
+	// List the folder once. The folder is canonicalized once rather than every file in it.
+	const path folder = canonical(argv[1]);
+	vector<path> files;
 	using boost::filesystem::directory_iterator;
 	const directory_iterator end_dir_iter; // A default constructed directory_iterator acts as the end iterator.
-	for (directory_iterator dir_iter(argv[1]); dir_iter != end_dir_iter; ++dir_iter)
+	for (directory_iterator dir_iter(folder); dir_iter != end_dir_iter; ++dir_iter)
 	{
 		// Skip non-regular files such as folders.
 		if (!boost::filesystem::is_regular_file(dir_iter->status())) continue;
-		const path p = dir_iter->path();
-		boost::filesystem::fstream in(p);
-		while (getline(in, line))
+		files.push_back(dir_iter->path());
+	}
+
+	// Split the listing into contiguous chunks, one per worker thread, and let each worker scan and sort its own chunk.
+	const size_t num_files = files.size();
+	vector<vector<summary>> chunks(num_threads);
+	vector<thread> workers;
+	workers.reserve(num_threads);
+	for (size_t t = 0; t < num_threads; ++t)
+	{
+		workers.emplace_back([&, t]()
 		{
-			if (starts_with(line, "REMARK VINA RESULT:"))
+			vector<summary>& chunk = chunks[t];
+			const size_t beg = num_files * t / num_threads;
+			const size_t end = num_files * (t + 1) / num_threads;
+			chunk.reserve(end - beg);
+			for (size_t i = beg; i < end; ++i)
 			{
-				energies.push_back(right_cast<fl>(line, 20, 29));
+				vector<fl> energies = scan(files[i]);
+				if (energies.empty()) continue;
+				chunk.emplace_back(move(files[i]), move(energies));
 			}
-			else if (starts_with(line, "REMARK       NORMALIZED FREE ENERGY PREDICTED BY IDOCK:"))
+			sort(chunk.begin(), chunk.end());
+		});
+	}
+	for (auto& w : workers) w.join();
+
+	// Merge the sorted chunks pairwise in parallel.
+	for (size_t stride = 1; stride < num_threads; stride <<= 1)
+	{
+		workers.clear();
+		for (size_t t = 0; t + stride < num_threads; t += stride << 1)
+		{
+			workers.emplace_back([&, t, stride]()
 			{
-				energies.push_back(right_cast<fl>(line, 56, 63));
-			}
+				vector<summary>& a = chunks[t];
+				vector<summary>& b = chunks[t + stride];
+				vector<summary> c;
+				c.reserve(a.size() + b.size());
+				merge(make_move_iterator(a.begin()), make_move_iterator(a.end()), make_move_iterator(b.begin()), make_move_iterator(b.end()), back_inserter(c));
+				a.swap(c);
+				vector<summary>().swap(b);
+			});
 		}
-		summaries.push_back(new summary(canonical(p), energies));
-		energies.clear();
+		for (auto& w : workers) w.join();
 	}
-	summaries.sort();
+	const vector<summary>& summaries = chunks.front();
+
 	cout << "ligand,no. of conformations";
 	for (size_t i = 1; i <= 9; ++i)
 	{
@@ -91,10 +163,8 @@ int main(int argc, char* argv[])
 	}
 	cout.setf(std::ios::fixed, std::ios::floatfield);
 	cout << '\n' << std::setprecision(3);
-	const size_t num_summaries = summaries.size();
-	for (size_t i = 0; i < num_summaries; ++i)
+	for (const summary& s : summaries)
 	{
-		const summary& s = summaries[i];
 		const size_t num_conformations = s.energies.size();
 		cout << s.filename << ',' << num_conformations;
 		for (size_t j = 0; j < num_conformations; ++j)
@@ -103,6 +173,6 @@ int main(int argc, char* argv[])
 		}
 		cout << '\n';
 	}
-	
+
 	return 0;
 }
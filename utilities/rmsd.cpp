@@ -1,61 +1,148 @@
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <vector>
 #include <fstream>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <numeric>
+#include "../src/rmsd.hpp"
 using namespace std;
 
-int main(int argc, char* argv[])
+//! Returns every bond preserving mapping of the reference molecule onto the docked molecule. Falls back to the atom order if no mapping exists, e.g. when bonds cannot be perceived consistently.
+vector<vector<size_t>> mappings_of(const rmsd_molecule& ref, const rmsd_molecule& docked)
 {
-	if (argc != 3)
+	vector<vector<size_t>> mappings = isomorphisms(ref, docked);
+	if (mappings.empty())
 	{
-		cout << "rmsd reference.pdbqt docked.pdbqt\n";
-		return 1;
+		mappings.emplace_back(ref.na);
+		iota(mappings.back().begin(), mappings.back().end(), 0);
 	}
+	return mappings;
+}
 
-	string line;
-	vector<double> ref_x, ref_y, ref_z;
-	for (ifstream ifs(argv[1]); getline(ifs, line);)
+//! Returns a reference pose permuted by every mapping.
+vector<vector<float>> permute_all(const rmsd_molecule& ref, const vector<vector<size_t>>& mappings, const size_t pose)
+{
+	vector<vector<float>> permuted(mappings.size(), vector<float>(3 * ref.stride));
+	for (size_t k = 0; k < mappings.size(); ++k)
+	{
+		permute(ref.poses[pose].data(), mappings[k], ref.stride, permuted[k].data());
+	}
+	return permuted;
+}
+
+//! Prints the symmetry corrected RMSD of every docked pose against the first reference pose.
+string compare(const string& ref_path, const string& docked_path, const bool prefix)
+{
+	ifstream rs(ref_path), ds(docked_path);
+	const rmsd_molecule ref(rs), docked(ds);
+	ostringstream os;
+	os.setf(ios::fixed, ios::floatfield);
+	os << setprecision(2);
+	if (ref.poses.empty() || ref.na != docked.na)
+	{
+		cerr << "Heavy atoms of " << ref_path << " and " << docked_path << " do not match" << endl;
+		return os.str();
+	}
+	const vector<vector<float>> permuted = permute_all(ref, mappings_of(ref, docked), 0);
+	for (size_t j = 0; j < docked.poses.size(); ++j)
 	{
-		const string record = line.substr(0, 6);
-		if (record == "ATOM  " || record == "HETATM")
+		if (prefix) os << docked_path << ',' << j + 1 << ',';
+		os << rmsd(permuted, docked.poses[j].data(), docked.stride, docked.na) << '\n';
+	}
+	return os.str();
+}
+
+//! Prints the symmetric matrix of symmetry corrected RMSD between every pair of poses of a docked file.
+string matrix(const string& docked_path)
+{
+	ifstream ds(docked_path);
+	const rmsd_molecule docked(ds);
+	const size_t n = docked.poses.size();
+	vector<float> mat(n * n);
+
+	// Search the automorphisms of the molecule once, and permute every pose by them.
+	const vector<vector<size_t>> mappings = mappings_of(docked, docked);
+	for (size_t i = 0; i < n; ++i)
+	{
+		const vector<vector<float>> permuted = permute_all(docked, mappings, i);
+		for (size_t j = i + 1; j < n; ++j)
 		{
-			const string element = line.substr(77, 2);
-			if (!(element == "H " || element == "HD"))
-			{
-				ref_x.push_back(stod(line.substr(30, 8)));
-				ref_y.push_back(stod(line.substr(38, 8)));
-				ref_z.push_back(stod(line.substr(46, 8)));
-			}
+			mat[i * n + j] = mat[j * n + i] = rmsd(permuted, docked.poses[j].data(), docked.stride, docked.na);
+		}
+	}
+	ostringstream os;
+	os.setf(ios::fixed, ios::floatfield);
+	os << setprecision(2) << docked_path << '\n';
+	for (size_t i = 0; i < n; ++i)
+	{
+		for (size_t j = 0; j < n; ++j)
+		{
+			os << (j ? "," : "") << mat[i * n + j];
 		}
+		os << '\n';
+	}
+	return os.str();
+}
+
+int main(int argc, char* argv[])
+{
+	// Parse flags.
+	size_t num_threads = max<size_t>(thread::hardware_concurrency(), 1);
+	bool matrix_mode = false;
+	string pairs_path;
+	vector<string> args;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-j") && i + 1 < argc) num_threads = max<size_t>(stoul(argv[++i]), 1);
+		else if (!strcmp(argv[i], "-m")) matrix_mode = true;
+		else if (!strcmp(argv[i], "-l") && i + 1 < argc) pairs_path = argv[++i];
+		else args.push_back(argv[i]);
+	}
+	if ((matrix_mode && args.empty()) || (!matrix_mode && pairs_path.empty() && args.size() < 2))
+	{
+		cout << "rmsd [-j threads] reference.pdbqt docked.pdbqt [docked.pdbqt ...]\n"
+		        "rmsd [-j threads] -l pairs.txt, where each line is reference.pdbqt docked.pdbqt\n"
+		        "rmsd [-j threads] -m docked.pdbqt [docked.pdbqt ...]\n";
+		return 1;
 	}
-	const double n_inv = 1.0 / ref_x.size();
 
-	cout.setf(ios::fixed, ios::floatfield);
-	cout << setprecision(2);
-	double se = 0;
-	size_t i = 0;
-	for (ifstream ifs(argv[2]); getline(ifs, line);)
+	// Build the job list.
+	vector<pair<string, string>> jobs;
+	if (matrix_mode)
 	{
-		const string record = line.substr(0, 6);
-		if (record == "ATOM  " || record == "HETATM")
+		for (const string& a : args) jobs.emplace_back(string(), a);
+	}
+	else if (!pairs_path.empty())
+	{
+		ifstream ifs(pairs_path);
+		for (string ref, docked; ifs >> ref >> docked;) jobs.emplace_back(ref, docked);
+	}
+	else
+	{
+		for (size_t i = 1; i < args.size(); ++i) jobs.emplace_back(args[0], args[i]);
+	}
+
+	// Process jobs in parallel, and print their outputs in order.
+	const bool prefix = jobs.size() > 1;
+	vector<string> outputs(jobs.size());
+	atomic<size_t> next(0);
+	vector<thread> workers;
+	for (size_t t = 0; t < min(num_threads, jobs.size()); ++t)
+	{
+		workers.emplace_back([&]()
 		{
-			const string element = line.substr(77, 2);
-			if (!(element == "H " || element == "HD"))
+			for (size_t i; (i = next++) < jobs.size();)
 			{
-				const double dx = ref_x[i] - stod(line.substr(30, 8));
-				const double dy = ref_y[i] - stod(line.substr(38, 8));
-				const double dz = ref_z[i] - stod(line.substr(46, 8));
-				se += dx * dx + dy * dy + dz * dz;
-				++i;
+				outputs[i] = matrix_mode ? matrix(jobs[i].second) : compare(jobs[i].first, jobs[i].second, prefix);
 			}
-		}
-		else if (record == "TORSDO")
-		{
-			cout << sqrt(se * n_inv) << endl;
-			se = i = 0;
-		}
+		});
 	}
+	for (auto& w : workers) w.join();
+	for (const string& o : outputs) cout << o;
 }
@@ -5,8 +5,13 @@
 #include <algorithm>
 #include <vector>
 #include <fstream>
+#include <sstream>
 #include <limits>
+#include <thread>
+#include <atomic>
 #include <cassert>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
 using namespace std;
 
 class atom
@@ -190,6 +195,7 @@ const array<size_t, atom::n> atom::ad_to_xs =
 };
 
 atom::atom(const string& line) :
+	serial(stoul(line.substr(6, 5))),
 	ad(find(ad_strings.cbegin(), ad_strings.cend(), line.substr(77, isspace(line[78]) ? 1 : 2)) - ad_strings.cbegin()),
 	xs(ad_to_xs[ad])
 {
@@ -249,10 +255,23 @@ inline bool is_hbacceptor(const size_t t)
 	return t ==  4 || t ==  5 || t ==  6 || t ==  7;
 }
 
+/// Represents a ROOT or a BRANCH in PDBQT structure.
+class frame
+{
+public:
+	size_t parent; ///< Frame array index pointing to the parent of current frame. For ROOT frame, this field is not used.
+	size_t rotorXidx; ///< Index pointing to the parent frame atom which forms a rotatable bond with the rotorY atom of current frame.
+	size_t rotorYidx; ///< Index pointing to the current frame atom which forms a rotatable bond with the rotorX atom of parent frame.
+	size_t childYidx; ///< The exclusive ending index to the heavy atoms of the current frame.
+
+	/// Constructs an active frame, and relates it to its parent frame.
+	explicit frame(const size_t parent, const size_t rotorXidx, const size_t rotorYidx) : parent(parent), rotorXidx(rotorXidx), rotorYidx(rotorYidx) {}
+};
+
 class ligand : public vector<atom>
 {
 public:
-	/// Load current ligand from an ifstream
+	/// Load current ligand from an istream, stopping after its TORSDOF line.
 	explicit ligand(istream& ifs);
 
 	/// Ligand properties.
@@ -261,30 +280,34 @@ public:
 	size_t num_hydrogen_bond_acceptors;
 	size_t num_active_torsions;
 	size_t num_inactive_torsions;
+	size_t num_interacting_pairs; ///< Number of intra-ligand interacting pairs that are not 1-4, i.e. np in idock.
 	float molecular_weight;
 	vector<float> mn;
 	vector<float> mx;
 	vector<float> sz;
-};
 
-/// Represents a ROOT or a BRANCH in PDBQT structure.
-class frame
-{
-public:
-	size_t parent; ///< Frame array index pointing to the parent of current frame. For ROOT frame, this field is not used.
-	size_t rotorYidx; ///< Index pointing to the current frame atom which forms a rotatable bond with the rotorX atom of parent frame.
+	/// Returns the number of variables to optimize, i.e. nv in idock.
+	size_t nv() const
+	{
+		return 6 + num_active_torsions;
+	}
 
-	/// Constructs an active frame, and relates it to its parent frame.
-	explicit frame(const size_t parent, const size_t rotorYidx) : parent(parent), rotorYidx(rotorYidx) {}
+	/// Returns the cost of docking the ligand in arbitrary units, proportional to the work of one evaluate() call, i.e. na + np, plus one BFGS update of the inverse Hessian, i.e. nv * (nv + 1) / 2.
+	size_t cost() const
+	{
+		return size() + num_interacting_pairs + (nv() * (nv() + 1) >> 1);
+	}
 };
 
-ligand::ligand(istream& ifs) : num_hydrogens(0), num_hydrogen_bond_donors(0), num_hydrogen_bond_acceptors(0), num_active_torsions(0), num_inactive_torsions(0), molecular_weight(0), mn(3, numeric_limits<float>::max()), mx(3, numeric_limits<float>::lowest()), sz(3)
+ligand::ligand(istream& ifs) : num_hydrogens(0), num_hydrogen_bond_donors(0), num_hydrogen_bond_acceptors(0), num_active_torsions(0), num_inactive_torsions(0), num_interacting_pairs(0), molecular_weight(0), mn(3, numeric_limits<float>::max()), mx(3, numeric_limits<float>::lowest()), sz(3)
 {
 	// Initialize necessary variables for constructing a ligand.
 	vector<frame> frames; ///< ROOT and BRANCH frames.
 	frames.reserve(30); // A ligand typically consists of <= 30 frames.
-	frames.emplace_back(0, 0); // ROOT is also treated as a frame. The parent of ROOT frame is dummy.
+	frames.emplace_back(0, 0, 0); // ROOT is also treated as a frame. The parent and rotorXidx of ROOT frame are dummy.
 	reserve(100); // A ligand typically consists of <= 100 heavy atoms.
+	vector<vector<size_t>> bonds; // Covalent bonds.
+	bonds.reserve(100);
 
 	// Initialize helper variables for parsing.
 	size_t current = 0; // Index of current frame, initialized to ROOT frame.
@@ -316,8 +339,20 @@ ligand::ligand(istream& ifs) : num_hydrogens(0), num_hydrogen_bond_donors(0), nu
 			{
 				num_hydrogen_bond_donors += is_hbdonor(a.xs);
 				num_hydrogen_bond_acceptors += is_hbacceptor(a.xs);
+
+				// Find bonds between the current atom and the other atoms of the same frame.
+				bonds.emplace_back();
+				for (size_t i = size(); i > f->rotorYidx;)
+				{
+					if (a.has_covalent_bond((*this)[--i]))
+					{
+						bonds[size()].push_back(i);
+						bonds[i].push_back(size());
+					}
+				}
+
 				// Save the heavy atom.
-				push_back(move(a));
+				push_back(a);
 			}
 			molecular_weight += a.atomic_weight();
 			for (size_t i = 0; i < 3; ++i)
@@ -328,14 +363,22 @@ ligand::ligand(istream& ifs) : num_hydrogens(0), num_hydrogen_bond_donors(0), nu
 		}
 		else if (record == "BRANCH")
 		{
+			// Find the rotor X atom in the current frame by its serial number.
+			const size_t rotorXsrn = stoul(line.substr(6, 4));
+			size_t rotorXidx = f->rotorYidx;
+			while (rotorXidx < size() && (*this)[rotorXidx].serial != rotorXsrn) ++rotorXidx;
+
 			// Insert a new frame whose parent is the current frame.
-			frames.push_back(frame(current, size()));
+			frames.push_back(frame(current, rotorXidx, size()));
 
 			// Now the current frame is the newly inserted BRANCH frame.
 			current = frames.size() - 1;
 
 			// Update the pointer to the current frame.
 			f = &frames[current];
+
+			// The ending index of atoms of previous frame is the starting index of atoms of current frame.
+			frames[current - 1].childYidx = f->rotorYidx;
 		}
 		else if (record == "ENDBRA")
 		{
@@ -350,6 +393,13 @@ ligand::ligand(istream& ifs) : num_hydrogens(0), num_hydrogen_bond_donors(0), nu
 				++num_active_torsions;
 			}
 
+			// Set up bonds between rotorX and rotorY.
+			if (f->rotorXidx < size() && f->rotorYidx < size())
+			{
+				bonds[f->rotorYidx].push_back(f->rotorXidx);
+				bonds[f->rotorXidx].push_back(f->rotorYidx);
+			}
+
 			// Now the parent of the following frame is the parent of current frame.
 			current = f->parent;
 
@@ -365,18 +415,218 @@ ligand::ligand(istream& ifs) : num_hydrogens(0), num_hydrogen_bond_donors(0), nu
 	{
 		sz[i] = 1.5f * (mx[i] - mn[i]);
 	}
+	frames.back().childYidx = size();
+
+	// Count intra-ligand interacting pairs that are not 1-4, in the same way as idock does.
+	vector<size_t> neighbors;
+	for (size_t k1 = 0; k1 < frames.size(); ++k1)
+	{
+		const frame& f1 = frames[k1];
+		for (size_t i = f1.rotorYidx; i < f1.childYidx; ++i)
+		{
+			// Find neighbor atoms within 3 consecutive covalent bonds.
+			for (const size_t b1 : bonds[i])
+			{
+				neighbors.push_back(b1);
+				for (const size_t b2 : bonds[b1])
+				{
+					neighbors.push_back(b2);
+					for (const size_t b3 : bonds[b2])
+					{
+						neighbors.push_back(b3);
+					}
+				}
+			}
+			for (size_t k2 = k1 + 1; k2 < frames.size(); ++k2)
+			{
+				const frame& f2 = frames[k2];
+				const frame& f3 = frames[f2.parent];
+				for (size_t j = f2.rotorYidx; j < f2.childYidx; ++j)
+				{
+					if (k1 == f2.parent && (i == f2.rotorXidx || j == f2.rotorYidx)) continue;
+					if (k1 > 0 && f1.parent == f2.parent && i == f1.rotorYidx && j == f2.rotorYidx) continue;
+					if (f2.parent > 0 && k1 == f3.parent && i == f3.rotorXidx && j == f2.rotorYidx) continue;
+					if (find(neighbors.cbegin(), neighbors.cend(), j) != neighbors.cend()) continue;
+					++num_interacting_pairs;
+				}
+			}
+			neighbors.clear();
+		}
+	}
 }
 
+/// Represents a ligand to profile, either a file of a folder or a molecule of a multi-molecule library.
+class job
+{
+public:
+	string name;
+	boost::filesystem::path p; ///< Path of a single ligand file, or empty if text holds the molecule.
+	string text;
+};
+
+/// Represents a histogram of a descriptor over a library.
+class histogram : public vector<size_t>
+{
+public:
+	explicit histogram(const string& name, const double width) : name(name), width(width) {}
+
+	void add(const double v)
+	{
+		const size_t b = static_cast<size_t>(v / width);
+		if (b >= size()) resize(b + 1);
+		++(*this)[b];
+	}
+
+	void write(ostream& os) const
+	{
+		for (size_t b = 0; b < size(); ++b)
+		{
+			if ((*this)[b]) os << name << ',' << b * width << ',' << (*this)[b] << '\n';
+		}
+	}
+private:
+	const string name;
+	const double width;
+};
+
 int main(int argc, char* argv[])
 {
-	ligand lig(cin);
-	if (lig.empty())
+	// Parse flags. The default seconds per cost unit per Monte Carlo task per generation is calibrated on the bundled ZINC ligands.
+	size_t num_threads = max<size_t>(thread::hardware_concurrency(), 1);
+	size_t num_tasks = 256;
+	size_t num_generations = 300;
+	double seconds_per_unit = 5.5e-7;
+	string histogram_path;
+	vector<string> sources;
+	for (int i = 1; i < argc; ++i)
+	{
+		const string a = argv[i];
+		if (a == "-j" && i + 1 < argc) num_threads = max<size_t>(stoul(argv[++i]), 1);
+		else if (a == "-t" && i + 1 < argc) num_tasks = stoul(argv[++i]);
+		else if (a == "-g" && i + 1 < argc) num_generations = stoul(argv[++i]);
+		else if (a == "-s" && i + 1 < argc) seconds_per_unit = stod(argv[++i]);
+		else if (a == "-o" && i + 1 < argc) histogram_path = argv[++i];
+		else if (a == "-h")
+		{
+			cout << "statligand [-j threads] [-t tasks] [-g generations] [-s seconds_per_unit] [-o histograms.csv] [ligand_folder_or_library ...] < ligand.pdbqt\n";
+			return 0;
+		}
+		else sources.push_back(a);
+	}
+	const double seconds_per_ligand_unit = seconds_per_unit * num_tasks * num_generations;
+
+	histogram nv_histogram("nv", 1), na_histogram("na", 1), np_histogram("np", 10), runtime_histogram("runtime", 1);
+	size_t num_ligands = 0;
+	double total_seconds = 0;
+
+	cout << "Ligand,H,HA,HBD,HBA,NAT,NIT,MWT,size_x,size_y,size_z,nv,np,cost,runtime" << endl;
+	cout.setf(ios::fixed, ios::floatfield);
+
+	// Profile a batch of ligands in parallel, then write their rows in order and aggregate their histograms.
+	const size_t batch_size = 4096;
+	vector<job> batch;
+	batch.reserve(batch_size);
+	vector<string> rows(batch_size);
+	vector<double> runtimes(batch_size);
+	vector<array<size_t, 3>> descriptors(batch_size);
+	vector<bool> valid(batch_size);
+	const auto flush = [&]()
+	{
+		atomic<size_t> next(0);
+		vector<thread> workers;
+		for (size_t t = 0; t < min(num_threads, batch.size()); ++t)
+		{
+			workers.emplace_back([&]()
+			{
+				for (size_t i; (i = next++) < batch.size();)
+				{
+					const job& j = batch[i];
+					boost::filesystem::ifstream fs;
+					istringstream ss;
+					if (j.p.empty()) ss.str(j.text); else fs.open(j.p);
+					const ligand lig(j.p.empty() ? static_cast<istream&>(ss) : fs);
+					valid[i] = !lig.empty();
+					if (!valid[i]) continue;
+					runtimes[i] = lig.cost() * seconds_per_ligand_unit;
+					descriptors[i] = {{ lig.nv(), lig.size(), lig.num_interacting_pairs }};
+					ostringstream os;
+					os.setf(ios::fixed, ios::floatfield);
+					os << j.name << ',' << lig.num_hydrogens + lig.size() << ',' << lig.size() << ',' << lig.num_hydrogen_bond_donors << ',' << lig.num_hydrogen_bond_acceptors << ',' << lig.num_active_torsions << ',' << lig.num_inactive_torsions << ',' << setprecision(3) << lig.molecular_weight << ',' << lig.sz[0] << ',' << lig.sz[1] << ',' << lig.sz[2] << ',' << lig.nv() << ',' << lig.num_interacting_pairs << ',' << lig.cost() << ',' << runtimes[i] << '\n';
+					rows[i] = os.str();
+				}
+			});
+		}
+		for (auto& w : workers) w.join();
+		for (size_t i = 0; i < batch.size(); ++i)
+		{
+			if (!valid[i]) continue;
+			cout << rows[i];
+			nv_histogram.add(descriptors[i][0]);
+			na_histogram.add(descriptors[i][1]);
+			np_histogram.add(descriptors[i][2]);
+			runtime_histogram.add(runtimes[i]);
+			total_seconds += runtimes[i];
+			++num_ligands;
+		}
+		batch.clear();
+	};
+
+	// Split a multi-molecule library into molecules, each of which ends with a TORSDOF or ENDMDL line.
+	const auto split = [&](istream& is, const string& source)
+	{
+		string text, name, line;
+		size_t index = 0;
+		while (getline(is, line))
+		{
+			if (line.compare(0, 15, "REMARK  Name = ") == 0) name = line.substr(15);
+			text += line;
+			text += '\n';
+			if (line.compare(0, 6, "TORSDO") && line.compare(0, 6, "ENDMDL")) continue;
+			++index;
+			batch.push_back({ name.empty() ? source + ':' + to_string(index) : name, boost::filesystem::path(), move(text) });
+			text.clear();
+			name.clear();
+			if (batch.size() == batch_size) flush();
+		}
+		if (text.find("ATOM  ") != string::npos || text.find("HETATM") != string::npos)
+		{
+			batch.push_back({ name.empty() ? source + ':' + to_string(index + 1) : name, boost::filesystem::path(), move(text) });
+		}
+	};
+
+	if (sources.empty())
+	{
+		split(cin, "stdin");
+	}
+	for (const string& s : sources)
 	{
-		cout << "H,HA,HBD,HBA,NAT,NIT,MWT,size_x,size_y,size_z" << endl;
+		if (boost::filesystem::is_directory(s))
+		{
+			for (boost::filesystem::directory_iterator dir_iter(s), end_dir_iter; dir_iter != end_dir_iter; ++dir_iter)
+			{
+				const boost::filesystem::path& p = dir_iter->path();
+				if (p.extension() != ".pdbqt") continue;
+				batch.push_back({ p.stem().string(), p, string() });
+				if (batch.size() == batch_size) flush();
+			}
+		}
+		else
+		{
+			boost::filesystem::ifstream ifs(s);
+			split(ifs, boost::filesystem::path(s).stem().string());
+		}
 	}
-	else
+	flush();
+
+	// Write the histograms that feed docking cost prediction.
+	if (!histogram_path.empty())
 	{
-		cout.setf(ios::fixed, ios::floatfield);
-		cout << lig.num_hydrogens + lig.size() << ',' << lig.size() << ',' << lig.num_hydrogen_bond_donors << ',' << lig.num_hydrogen_bond_acceptors << ',' << lig.num_active_torsions << ',' << lig.num_inactive_torsions << ',' << setprecision(3) << lig.molecular_weight << ',' << lig.sz[0] << ',' << lig.sz[1] << ',' << lig.sz[2] << endl;
+		boost::filesystem::ofstream hs(histogram_path);
+		hs << "descriptor,bin,count\n";
+		nv_histogram.write(hs);
+		na_histogram.write(hs);
+		np_histogram.write(hs);
+		runtime_histogram.write(hs);
 	}
+	cerr << num_ligands << " ligands, predicted " << setprecision(3) << total_seconds / 3600 << " core-hours with " << num_tasks << " tasks of " << num_generations << " generations" << endl;
 }